@@ -104,6 +104,28 @@ int HAL_ReceiveIPPacket(int if_index_mask, uint8_t *buffer, size_t length,
 int HAL_SendIPPacket(int if_index, uint8_t *buffer, size_t length,
                      macaddr_t dst_mac);
 
+/**
+ * @brief 端口状态变化的回调函数
+ *
+ * @param if_index 接口索引号，[0, N_IFACE_ON_BOARD-1]
+ * @param up 非零表示链路连通，零表示链路断开或网卡不存在
+ * @param addr 端口当前的 IPv4 地址，0 表示没有地址
+ */
+typedef void (*HAL_InterfaceCallback)(int if_index, int up, in_addr_t addr);
+
+/**
+ * @brief 注册端口状态变化的回调
+ *
+ * 端口的链路状态或 IPv4 地址变化时，HAL_ReceiveIPPacket
+ * 会调用回调函数，然后立即返回 0 ，使调用者能及时处理定时器；HAL_Init
+ * 假定所有端口都是连通的、地址为 if_addrs ，注册时实际状态与之不同的端口会立即各报告一次。
+ * Linux 后端通过 rtnetlink 获取链路和地址的变化，其他后端不支持
+ *
+ * @param callback IN，回调函数，NULL 表示取消
+ * @return int 0 表示成功，非 0 为失败
+ */
+int HAL_SetInterfaceCallback(HAL_InterfaceCallback callback);
+
 #ifdef __cplusplus
 }
 #endif
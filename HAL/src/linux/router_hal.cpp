@@ -2,8 +2,11 @@
 #include "router_hal_common.h"
 #include <stdio.h>
 
+#include <errno.h>
 #include <ifaddrs.h>
 #include <linux/if_packet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <map>
 #include <net/if.h>
 #include <net/if_arp.h>
@@ -14,6 +17,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <time.h>
+#include <unistd.h>
 #include <utility>
 
 #ifndef HAL_PLATFORM_TESTING
@@ -35,6 +39,101 @@ pcap_t *pcap_out_handles[N_IFACE_ON_BOARD];
 std::map<std::pair<in_addr_t, int>, macaddr_t> arp_table;
 std::map<std::pair<in_addr_t, int>, uint64_t> arp_timer;
 
+// link state of interfaces, kept up to date by rtnetlink
+int netlink_fd = -1;
+int interface_up[N_IFACE_ON_BOARD] = {0};
+HAL_InterfaceCallback interface_callback = NULL;
+
+// read the current link state and IPv4 address of every interface
+void read_interfaces(int *up, in_addr_t *addrs) {
+  for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
+    up[i] = 0;
+    addrs[i] = 0;
+  }
+  struct ifaddrs *ifaddr, *ifa;
+  if (getifaddrs(&ifaddr) < 0) {
+    return;
+  }
+  for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+    for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
+      if (strcmp(ifa->ifa_name, interfaces[i]) != 0) {
+        continue;
+      }
+      up[i] = (ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING);
+      if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET) {
+        in_addr_t addr = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+        // keep the current address while it is still configured
+        if (addrs[i] == 0 || addr == interface_addrs[i]) {
+          addrs[i] = addr;
+        }
+      }
+      break;
+    }
+  }
+  freeifaddrs(ifaddr);
+}
+
+// compare with the known state, and report the interfaces that changed
+bool sync_interfaces() {
+  int up[N_IFACE_ON_BOARD];
+  in_addr_t addrs[N_IFACE_ON_BOARD];
+  read_interfaces(up, addrs);
+  bool changed = false;
+  for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
+    if (up[i] == interface_up[i] && addrs[i] == interface_addrs[i]) {
+      continue;
+    }
+    if (addrs[i] != interface_addrs[i]) {
+      // the address of this interface is answered in ARP
+      arp_table.erase(std::pair<in_addr_t, int>(interface_addrs[i], i));
+      if (addrs[i] != 0) {
+        memcpy(arp_table[std::pair<in_addr_t, int>(addrs[i], i)],
+               interface_mac[i], sizeof(macaddr_t));
+      }
+      interface_addrs[i] = addrs[i];
+    }
+    if (up[i] && !interface_up[i] && addrs[i] != 0 && pcap_out_handles[i]) {
+      HAL_JoinIGMPGroup(i, addrs[i]);
+    }
+    interface_up[i] = up[i];
+    if (debugEnabled) {
+      fprintf(stderr, "HAL: interface %s is %s with address %s\n",
+              interfaces[i], up[i] ? "up" : "down",
+              inet_ntoa(in_addr{addrs[i]}));
+    }
+    changed = true;
+    if (interface_callback) {
+      interface_callback(i, up[i], addrs[i]);
+    }
+  }
+  return changed;
+}
+
+// drain link and address notifications; they are rare, so any of them
+// (or a lost one) just triggers a full comparison; the socket is checked
+// at most once per millisecond tick so the receive path stays one syscall
+bool poll_interface_events() {
+  static uint64_t last_poll = 0;
+  if (netlink_fd < 0) {
+    return false;
+  }
+  uint64_t now = HAL_GetTicks();
+  if (now == last_poll) {
+    return false;
+  }
+  last_poll = now;
+  char buffer[8192];
+  bool notified = false;
+  ssize_t len;
+  while ((len = recv(netlink_fd, buffer, sizeof(buffer), 0)) > 0) {
+    notified = true;
+  }
+  if (len < 0 && errno == ENOBUFS) {
+    notified = true;
+  }
+  return notified && sync_interfaces();
+}
+
 extern "C" {
 int HAL_Init(int debug, in_addr_t if_addrs[N_IFACE_ON_BOARD]) {
   if (inited) {
@@ -97,6 +196,26 @@ int HAL_Init(int debug, in_addr_t if_addrs[N_IFACE_ON_BOARD]) {
   }
 
   memcpy(interface_addrs, if_addrs, sizeof(interface_addrs));
+  for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
+    interface_up[i] = 1;
+  }
+
+  // subscribe to link and IPv4 address changes
+  netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      NETLINK_ROUTE);
+  if (netlink_fd >= 0) {
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR;
+    if (bind(netlink_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(netlink_fd);
+      netlink_fd = -1;
+    }
+  }
+  if (netlink_fd < 0 && debugEnabled) {
+    fprintf(stderr, "HAL_Init: rtnetlink unavailable, link state is not monitored\n");
+  }
 
   inited = true;
   // send igmp to join RIP multicast group
@@ -207,6 +326,10 @@ int HAL_ReceiveIPPacket(int if_index_mask, uint8_t *buffer, size_t length,
     return HAL_ERR_INVALID_PARAMETER;
   }
 
+  if (poll_interface_events()) {
+    return 0;
+  }
+
   bool flag = false;
   for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
     if (pcap_in_handles[i] && (if_index_mask & (1 << i))) {
@@ -309,6 +432,10 @@ int HAL_ReceiveIPPacket(int if_index_mask, uint8_t *buffer, size_t length,
     }
 
     current_port = (current_port + 1) % N_IFACE_ON_BOARD;
+    if (current_port == 0 && poll_interface_events()) {
+      // let the caller handle the change at once
+      return 0;
+    }
     // -1 for infinity
   } while ((current_time = HAL_GetTicks()) < begin + timeout || timeout == -1);
   return 0;
@@ -345,4 +472,18 @@ int HAL_SendIPPacket(int if_index, uint8_t *buffer, size_t length,
     return HAL_ERR_UNKNOWN;
   }
 }
+
+int HAL_SetInterfaceCallback(HAL_InterfaceCallback callback) {
+  if (!inited) {
+    return HAL_ERR_CALLED_BEFORE_INIT;
+  }
+  if (netlink_fd < 0) {
+    return HAL_ERR_NOT_SUPPORTED;
+  }
+  interface_callback = callback;
+  if (callback) {
+    sync_interfaces();
+  }
+  return 0;
+}
 }
\ No newline at end of file
@@ -390,4 +390,12 @@ int HAL_SendIPPacket(int if_index, uint8_t *buffer, size_t length,
     return HAL_ERR_UNKNOWN;
   }
 }
+
+int HAL_SetInterfaceCallback(HAL_InterfaceCallback callback) {
+  if (!inited) {
+    return HAL_ERR_CALLED_BEFORE_INIT;
+  }
+  // interfaces never change here
+  return HAL_ERR_NOT_SUPPORTED;
+}
 }
\ No newline at end of file
@@ -448,3 +448,11 @@ int HAL_SendIPPacket(int if_index, uint8_t *buffer, size_t length,
   XAxiDma_BdRingToHw(txRing, 1, bd);
   return 0;
 }
+
+int HAL_SetInterfaceCallback(HAL_InterfaceCallback callback) {
+  if (!inited) {
+    return HAL_ERR_CALLED_BEFORE_INIT;
+  }
+  // interfaces never change here
+  return HAL_ERR_NOT_SUPPORTED;
+}
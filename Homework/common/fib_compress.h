@@ -0,0 +1,324 @@
+#ifndef FIB_COMPRESS_H
+#define FIB_COMPRESS_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include "prefix_hash.h"
+#include "routing_table.h"
+
+/*
+  转发表压缩，按 ORTC（Optimal Routing Table Constructor, Draves et al.）的做法，
+  把最长前缀匹配结果完全相同的路由表换成前缀尽量少的等价表：
+    1. 把路由放进二叉 Trie ，补全只有一个孩子的节点，使每个叶子都有确定的转发动作；
+    2. 自底向上求每个节点可选的动作集合：两个孩子集合的交集，交集为空时取并集；
+    3. 自顶向下选择：继承来的动作在集合中则不需要表项，否则从集合中选一个并输出表项。
+  “没有路由”也是一种动作，但转发表无法表示“到这里为止没有路由”，所以子树中有
+  没有路由的地址时，这个节点的集合只能是“没有路由”，它和它的上级都不输出表项。
+
+  地址空间按 /8 分成 256 块，每块单独压缩，路由变化只把所在的块标记为脏，
+  flush 时重新压缩脏的块并输出与上次结果的差别。短于 /8 的路由作为它覆盖的各块的
+  默认路由。每块的结果都不依赖块外的表项，所以比全局的最优解多至多一项。
+  Same(a, b) 判断两条路由的转发动作是否相同。
+*/
+template <class Entry, class Same>
+class FibCompressor {
+public:
+  FibCompressor() : compressed(0) {
+    for (uint32_t b = 0; b < BLOCKS; b++) {
+      dirty[b] = false;
+    }
+  }
+
+  // 插入或替换一条路由
+  void insert(const Entry &entry) {
+    if (entry.len < 8) {
+      erase_short(entry.addr, entry.len);
+      shorts.push_back(entry);
+      mark_range(entry);
+      return;
+    }
+    uint32_t b = block_of(entry.addr);
+    uint32_t *pos = index.find(entry.addr, entry.len);
+    if (pos != NULL) {
+      // 只有 metric 变化时压缩结果不变
+      bool same = Same()(blocks[b].routes[*pos], entry);
+      blocks[b].routes[*pos] = entry;
+      if (same) {
+        return;
+      }
+    } else {
+      index.insert(entry.addr, entry.len, blocks[b].routes.size());
+      blocks[b].routes.push_back(entry);
+    }
+    mark(b);
+  }
+
+  void erase(uint32_t addr, uint32_t len) {
+    if (len < 8) {
+      Entry *old = find_short(addr, len);
+      if (old != NULL) {
+        Entry removed = *old;
+        erase_short(addr, len);
+        mark_range(removed);
+      }
+      return;
+    }
+    uint32_t *pos = index.find(addr, len);
+    if (pos == NULL) {
+      return;
+    }
+    uint32_t b = block_of(addr);
+    std::vector<Entry> &routes = blocks[b].routes;
+    uint32_t i = *pos;
+    index.erase(addr, len);
+    if (i + 1 != routes.size()) {
+      routes[i] = routes.back();
+      *index.find(routes[i].addr, routes[i].len) = i;
+    }
+    routes.pop_back();
+    mark(b);
+  }
+
+  // 重新压缩脏的块，对压缩结果的每个变化调用 f(bool insert, const Entry &entry)
+  template <class F>
+  void flush(F f) {
+    for (uint32_t k = 0; k < dirty_list.size(); k++) {
+      uint32_t b = dirty_list[k];
+      dirty[b] = false;
+      std::vector<Entry> out;
+      compress(b, &out);
+      apply_diff(blocks[b].out, out, f);
+      compressed += out.size();
+      compressed -= blocks[b].out.size();
+      blocks[b].out.swap(out);
+    }
+    dirty_list.clear();
+  }
+
+  void clear() {
+    for (uint32_t b = 0; b < BLOCKS; b++) {
+      blocks[b].routes.clear();
+      blocks[b].out.clear();
+      dirty[b] = false;
+    }
+    dirty_list.clear();
+    shorts.clear();
+    index = PrefixHash<uint32_t>();
+    compressed = 0;
+  }
+
+  // 是否有需要重新压缩的块
+  bool pending() const {
+    return !dirty_list.empty();
+  }
+
+  // 压缩后的表项个数，flush 之后有效
+  uint32_t size() const {
+    return compressed;
+  }
+
+private:
+  static const uint32_t BLOCKS = 256;
+  static const uint32_t DROP = 0; // 没有路由的动作编号
+
+  struct Block {
+    std::vector<Entry> routes; // 这一块中不短于 /8 的路由，无序
+    std::vector<Entry> out; // 上一次的压缩结果，按 (key, len) 排序
+  };
+
+  struct Node {
+    uint32_t child[2]; // 0 表示没有
+    uint32_t action; // 这个前缀本身的路由的动作，NONE 表示没有
+    uint32_t set_begin, set_size; // 可选动作集合在 sets 中的位置
+    bool drop; // 子树中有没有路由的地址
+  };
+
+  static const uint32_t NONE = 0xFFFFFFFF;
+
+  static uint32_t block_of(uint32_t addr) {
+    return rt_key(addr) >> 24;
+  }
+
+  void mark(uint32_t b) {
+    if (!dirty[b]) {
+      dirty[b] = true;
+      dirty_list.push_back(b);
+    }
+  }
+
+  void mark_range(const Entry &entry) {
+    uint32_t begin = block_of(entry.addr);
+    uint32_t count = 1 << (8 - entry.len);
+    for (uint32_t b = begin; b < begin + count; b++) {
+      mark(b);
+    }
+  }
+
+  Entry *find_short(uint32_t addr, uint32_t len) {
+    for (uint32_t i = 0; i < shorts.size(); i++) {
+      if (shorts[i].addr == addr && shorts[i].len == len) {
+        return &shorts[i];
+      }
+    }
+    return NULL;
+  }
+
+  void erase_short(uint32_t addr, uint32_t len) {
+    Entry *old = find_short(addr, len);
+    if (old != NULL) {
+      *old = shorts.back();
+      shorts.pop_back();
+    }
+  }
+
+  // 块 b 的默认路由：覆盖它的最长的短路由，没有则返回 NULL
+  const Entry *block_default(uint32_t b) const {
+    const Entry *res = NULL;
+    for (uint32_t i = 0; i < shorts.size(); i++) {
+      const Entry &s = shorts[i];
+      if (((b << 24) & rt_mask(s.len)) == rt_key(s.addr) && (res == NULL || s.len > res->len)) {
+        res = &s;
+      }
+    }
+    return res;
+  }
+
+  // 动作编号，相同动作的路由共用一个编号，reps[编号] 是代表它的路由
+  uint32_t action_of(const Entry &entry) {
+    for (uint32_t i = 1; i < reps.size(); i++) {
+      if (Same()(reps[i], entry)) {
+        return i;
+      }
+    }
+    reps.push_back(entry);
+    return reps.size() - 1;
+  }
+
+  uint32_t new_node(uint32_t action) {
+    Node node = {{0, 0}, action, 0, 0, false};
+    nodes.push_back(node);
+    return nodes.size() - 1;
+  }
+
+  void compress(uint32_t b, std::vector<Entry> *out) {
+    nodes.clear();
+    sets.clear();
+    reps.resize(1);
+    const Entry *def = block_default(b);
+    uint32_t root = new_node(def != NULL ? action_of(*def) : NONE);
+    const std::vector<Entry> &routes = blocks[b].routes;
+    for (uint32_t i = 0; i < routes.size(); i++) {
+      uint32_t key = rt_key(routes[i].addr);
+      uint32_t node = root;
+      for (uint32_t depth = 8; depth < routes[i].len; depth++) {
+        uint32_t bit = rt_bit(key, depth);
+        if (nodes[node].child[bit] == 0) {
+          uint32_t child = new_node(NONE);
+          nodes[node].child[bit] = child;
+        }
+        node = nodes[node].child[bit];
+      }
+      nodes[node].action = action_of(routes[i]);
+    }
+    compute_sets(root, DROP);
+    choose(root, DROP, b << 24, 8, out);
+  }
+
+  void compute_sets(uint32_t node, uint32_t inherited) {
+    uint32_t own = nodes[node].action != NONE ? nodes[node].action : inherited;
+    if (nodes[node].child[0] == 0 && nodes[node].child[1] == 0) {
+      nodes[node].set_begin = sets.size();
+      nodes[node].set_size = 1;
+      nodes[node].drop = own == DROP;
+      sets.push_back(own);
+      return;
+    }
+    // 补全孩子，补出的叶子沿用这里的动作
+    for (uint32_t bit = 0; bit < 2; bit++) {
+      if (nodes[node].child[bit] == 0) {
+        uint32_t child = new_node(NONE);
+        nodes[node].child[bit] = child;
+      }
+      compute_sets(nodes[node].child[bit], own);
+    }
+    const Node &l = nodes[nodes[node].child[0]];
+    const Node &r = nodes[nodes[node].child[1]];
+    uint32_t begin = sets.size();
+    if (l.drop || r.drop) {
+      sets.push_back((uint32_t)DROP);
+    } else {
+      const uint32_t *lb = &sets[l.set_begin], *rb = &sets[r.set_begin];
+      merged.clear();
+      std::set_intersection(lb, lb + l.set_size, rb, rb + r.set_size, std::back_inserter(merged));
+      if (merged.empty()) {
+        std::set_union(lb, lb + l.set_size, rb, rb + r.set_size, std::back_inserter(merged));
+      }
+      sets.insert(sets.end(), merged.begin(), merged.end());
+    }
+    nodes[node].drop = l.drop || r.drop;
+    nodes[node].set_begin = begin;
+    nodes[node].set_size = sets.size() - begin;
+  }
+
+  // 先序遍历，输出按 (key, len) 排序
+  void choose(uint32_t node, uint32_t inherited, uint32_t key, uint32_t len, std::vector<Entry> *out) {
+    const uint32_t *set = &sets[nodes[node].set_begin];
+    uint32_t size = nodes[node].set_size;
+    uint32_t action = inherited;
+    if (!std::binary_search(set, set + size, inherited)) {
+      action = set[0];
+      Entry entry = reps[action];
+      entry.addr = rt_key(key);
+      entry.len = len;
+      out->push_back(entry);
+    }
+    for (uint32_t bit = 0; bit < 2; bit++) {
+      uint32_t child = nodes[node].child[bit];
+      if (child != 0) {
+        choose(child, action, key | (bit << (31 - len)), len + 1, out);
+      }
+    }
+  }
+
+  static bool prefix_less(const Entry &a, const Entry &b) {
+    uint32_t ka = rt_key(a.addr), kb = rt_key(b.addr);
+    return ka != kb ? ka < kb : a.len < b.len;
+  }
+
+  template <class F>
+  static void apply_diff(const std::vector<Entry> &old, const std::vector<Entry> &now, F &f) {
+    uint32_t i = 0, j = 0;
+    while (i < old.size() || j < now.size()) {
+      if (j == now.size() || (i < old.size() && prefix_less(old[i], now[j]))) {
+        f(false, old[i]);
+        i++;
+      } else if (i == old.size() || prefix_less(now[j], old[i])) {
+        f(true, now[j]);
+        j++;
+      } else {
+        if (!Same()(old[i], now[j])) {
+          f(true, now[j]);
+        }
+        i++;
+        j++;
+      }
+    }
+  }
+
+  Block blocks[BLOCKS];
+  bool dirty[BLOCKS];
+  std::vector<uint32_t> dirty_list;
+  std::vector<Entry> shorts; // 短于 /8 的路由，很少
+  PrefixHash<uint32_t> index; // (addr, len) -> 所在块 routes 中的下标
+  uint32_t compressed;
+
+  // 压缩一块时的临时数据
+  std::vector<Node> nodes;
+  std::vector<uint32_t> sets;
+  std::vector<Entry> reps;
+  std::vector<uint32_t> merged;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+  路由表节点的分配器。
+
+  NodePool 从成块申请的内存（slab）中顺序切出节点，释放的节点挂到空闲链表上，
+  下次分配时优先复用。节点在内存中基本连续，路由频繁变动时也不会把堆打碎，
+  整个生命周期内 slab 只增不减，峰值之后不再调用 malloc。
+  HeapPool 接口相同，直接使用 new/delete，用于对比。
+*/
+
+template <class T>
+class NodePool {
+public:
+  NodePool() : free_list(NULL), cursor(0), capacity(0), live(0), total(0) {
+  }
+  ~NodePool() {
+    for (size_t i = 0; i < slabs.size(); i++) {
+      ::operator delete(slabs[i]);
+    }
+  }
+
+  template <class... Args>
+  T *create(Args &&... args) {
+    void *p;
+    if (free_list != NULL) {
+      p = free_list;
+      free_list = free_list->next;
+    } else {
+      if (cursor == capacity) {
+        grow();
+      }
+      p = &slabs.back()[cursor++];
+    }
+    live++;
+    return new (p) T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T *node) {
+    node->~T();
+    Slot *slot = reinterpret_cast<Slot *>(node);
+    slot->next = free_list;
+    free_list = slot;
+    live--;
+  }
+
+  // 向系统申请的字节数
+  size_t allocated_bytes() const {
+    return total * sizeof(Slot);
+  }
+
+  // 正在使用的节点占用的字节数
+  size_t used_bytes() const {
+    return live * sizeof(Slot);
+  }
+
+private:
+  union Slot {
+    Slot *next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  // slab 的大小从 64 个节点开始倍增，最大 4096 个
+  void grow() {
+    capacity = capacity == 0 ? 64 : (capacity < 4096 ? capacity * 2 : 4096);
+    slabs.push_back(static_cast<Slot *>(::operator new(capacity * sizeof(Slot))));
+    cursor = 0;
+    total += capacity;
+  }
+
+  std::vector<Slot *> slabs;
+  Slot *free_list;
+  size_t cursor; // 最后一个 slab 中下一个未使用的位置
+  size_t capacity; // 最后一个 slab 的节点数
+  size_t live;
+  size_t total;
+
+  NodePool(const NodePool &);
+  NodePool &operator=(const NodePool &);
+};
+
+template <class T>
+class HeapPool {
+public:
+  HeapPool() : live(0) {
+  }
+
+  template <class... Args>
+  T *create(Args &&... args) {
+    live++;
+    return new T(std::forward<Args>(args)...);
+  }
+
+  void destroy(T *node) {
+    delete node;
+    live--;
+  }
+
+  size_t allocated_bytes() const {
+    return live * sizeof(T);
+  }
+
+  size_t used_bytes() const {
+    return live * sizeof(T);
+  }
+
+private:
+  size_t live;
+};
+
+#endif
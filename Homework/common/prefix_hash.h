@@ -0,0 +1,121 @@
+#ifndef PREFIX_HASH_H
+#define PREFIX_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+  按精确前缀 (addr, len) 索引的哈希表，开放寻址、线性探测，
+  删除时把后面的项往前移，不留墓碑。查找、插入、删除都是期望 O(1)。
+  与做最长前缀匹配的 RoutingTable 互补：RIP 处理通告时只关心同一个前缀。
+*/
+template <class Value>
+class PrefixHash {
+public:
+  PrefixHash() : count(0) {
+    slots.resize(16);
+  }
+
+  Value *find(uint32_t addr, uint32_t len) {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(addr, len) & mask; slots[i].used; i = (i + 1) & mask) {
+      if (slots[i].addr == addr && slots[i].len == len) {
+        return &slots[i].value;
+      }
+    }
+    return NULL;
+  }
+
+  // 插入或替换，返回表中的值，在下一次插入或删除之前有效
+  Value *insert(uint32_t addr, uint32_t len, const Value &value) {
+    if ((count + 1) * 2 > slots.size()) {
+      rehash(slots.size() * 2);
+    }
+    size_t mask = slots.size() - 1;
+    size_t i = hash(addr, len) & mask;
+    for (; slots[i].used; i = (i + 1) & mask) {
+      if (slots[i].addr == addr && slots[i].len == len) {
+        slots[i].value = value;
+        return &slots[i].value;
+      }
+    }
+    slots[i].used = true;
+    slots[i].addr = addr;
+    slots[i].len = len;
+    slots[i].value = value;
+    count++;
+    return &slots[i].value;
+  }
+
+  bool erase(uint32_t addr, uint32_t len) {
+    size_t mask = slots.size() - 1;
+    size_t i = hash(addr, len) & mask;
+    for (; slots[i].used; i = (i + 1) & mask) {
+      if (slots[i].addr == addr && slots[i].len == len) {
+        break;
+      }
+    }
+    if (!slots[i].used) {
+      return false;
+    }
+    // 把探测链上后面的项移到空位，保证它们仍然能被找到
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+      size_t home = hash(slots[j].addr, slots[j].len) & mask;
+      if (((j - home) & mask) >= ((j - hole) & mask)) {
+        slots[hole] = slots[j];
+        hole = j;
+      }
+    }
+    slots[hole].used = false;
+    count--;
+    return true;
+  }
+
+  // f(addr, len, value)
+  template <class F>
+  void for_each(F f) {
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (slots[i].used) {
+        f(slots[i].addr, slots[i].len, slots[i].value);
+      }
+    }
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+private:
+  struct Slot {
+    bool used;
+    uint8_t len;
+    uint32_t addr;
+    Value value;
+    Slot() : used(false), len(0), addr(0), value() {
+    }
+  };
+
+  static size_t hash(uint32_t addr, uint32_t len) {
+    uint64_t h = (((uint64_t)addr << 6) | len) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32);
+  }
+
+  void rehash(size_t size) {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.resize(size);
+    count = 0;
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].used) {
+        insert(old[i].addr, old[i].len, old[i].value);
+      }
+    }
+  }
+
+  std::vector<Slot> slots;
+  uint32_t count;
+};
+
+#endif
@@ -0,0 +1,877 @@
+#ifndef ROUTING_TABLE_H
+#define ROUTING_TABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "node_pool.h"
+
+/*
+  路由表的公共实现，lookup 和 router 两个目录共用。
+
+  RoutingTable<Engine> 提供统一的接口：插入、删除、精确查找、最长前缀匹配、批量查询、
+  按出端口遍历和批量建表。具体的数据结构由 Engine 决定，在编译时选择：
+    ListEngine     链表，即最初的实现
+    TrieEngine     一位一层的二叉 Trie
+    Dir248Engine   DIR-24-8，两次访存完成一次查询
+    PatriciaEngine 路径压缩的二叉 Trie
+  编译时定义 ROUTING_ENGINE 为上面的某个名字即可切换，例如 make ENGINE=TrieEngine 。
+
+  Entry 需要有 addr（大端序）、len、if_index 三个字段，约定 addr 仅前 len 位可能非零。
+  内部统一把地址转换成主机序的 key，前缀位从最高位开始。
+  各 Engine 的节点都从第二个模板参数 Pool 中分配，默认是 node_pool.h 中的 NodePool 。
+*/
+
+#ifndef ROUTING_ENGINE
+#define ROUTING_ENGINE Dir248Engine
+#endif
+
+// 大端序地址转换成主机序的 key，1.2.3.4 对应 0x01020304
+inline uint32_t rt_key(uint32_t addr) {
+  return __builtin_bswap32(addr);
+}
+
+// 主机序的前缀掩码
+inline uint32_t rt_mask(uint32_t len) {
+  return len == 0 ? 0 : 0xFFFFFFFF << (32 - len);
+}
+
+// key 的第 i 位，从最高位数起
+inline uint32_t rt_bit(uint32_t key, uint32_t i) {
+  return (key >> (31 - i)) & 1;
+}
+
+/*
+  一位一层的二叉 Trie，保存 前缀 -> Value 的映射，
+  TrieEngine 直接用它保存表项，Dir248Engine 用它保存前缀到表项编号的映射。
+*/
+template <class Value, template <class> class Pool = NodePool>
+class BinaryTrie {
+public:
+  BinaryTrie() : count(0) {
+    root = pool.create();
+  }
+  ~BinaryTrie() {
+    clear();
+    pool.destroy(root);
+  }
+
+  // 插入或替换，新增时返回 true
+  bool insert(uint32_t key, uint32_t len, const Value &value) {
+    Node *node = root;
+    for (uint32_t i = 0; i < len; i++) {
+      uint32_t b = rt_bit(key, i);
+      if (node->child[b] == NULL) {
+        node->child[b] = pool.create();
+      }
+      node = node->child[b];
+    }
+    node->value = value;
+    if (node->valid) {
+      return false;
+    }
+    node->valid = true;
+    count++;
+    return true;
+  }
+
+  Value *find(uint32_t key, uint32_t len) {
+    Node *node = root;
+    for (uint32_t i = 0; i < len && node != NULL; i++) {
+      node = node->child[rt_bit(key, i)];
+    }
+    return node != NULL && node->valid ? &node->value : NULL;
+  }
+
+  // 删除并剪掉不再需要的节点，存在时返回 true
+  bool erase(uint32_t key, uint32_t len) {
+    Node *path[33];
+    path[0] = root;
+    for (uint32_t i = 0; i < len; i++) {
+      path[i + 1] = path[i]->child[rt_bit(key, i)];
+      if (path[i + 1] == NULL) {
+        return false;
+      }
+    }
+    if (!path[len]->valid) {
+      return false;
+    }
+    path[len]->valid = false;
+    count--;
+    for (uint32_t i = len; i > 0; i--) {
+      Node *node = path[i];
+      if (node->valid || node->child[0] != NULL || node->child[1] != NULL) {
+        break;
+      }
+      path[i - 1]->child[rt_bit(key, i - 1)] = NULL;
+      pool.destroy(node);
+    }
+    return true;
+  }
+
+  // 长度不超过 max_len 的最长匹配前缀
+  const Value *lookup(uint32_t key, uint32_t max_len = 32) const {
+    const Node *node = root;
+    const Value *best = NULL;
+    for (uint32_t i = 0; node != NULL; i++) {
+      if (node->valid) {
+        best = &node->value;
+      }
+      if (i >= max_len) {
+        break;
+      }
+      node = node->child[rt_bit(key, i)];
+    }
+    return best;
+  }
+
+  // 按前缀顺序遍历，f(key, len, value)
+  template <class F>
+  void for_each(F f) const {
+    visit(root, 0, 0, f);
+  }
+
+  void clear() {
+    for (int b = 0; b < 2; b++) {
+      destroy(root->child[b]);
+      root->child[b] = NULL;
+    }
+    root->valid = false;
+    count = 0;
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+  size_t allocated_bytes() const {
+    return pool.allocated_bytes();
+  }
+
+  size_t used_bytes() const {
+    return pool.used_bytes();
+  }
+
+private:
+  struct Node {
+    Node *child[2];
+    bool valid;
+    Value value;
+    Node() : valid(false) {
+      child[0] = child[1] = NULL;
+    }
+  };
+
+  template <class F>
+  static void visit(const Node *node, uint32_t key, uint32_t len, F &f) {
+    if (node->valid) {
+      f(key, len, node->value);
+    }
+    for (uint32_t b = 0; b < 2; b++) {
+      if (node->child[b] != NULL) {
+        visit(node->child[b], key | (b << (31 - len)), len + 1, f);
+      }
+    }
+  }
+
+  void destroy(Node *node) {
+    if (node == NULL) {
+      return;
+    }
+    destroy(node->child[0]);
+    destroy(node->child[1]);
+    pool.destroy(node);
+  }
+
+  Pool<Node> pool;
+  Node *root;
+  uint32_t count;
+
+  BinaryTrie(const BinaryTrie &);
+  BinaryTrie &operator=(const BinaryTrie &);
+};
+
+// 链表，插入、删除和查询都要遍历整个表
+template <class Entry, template <class> class Pool = NodePool>
+class ListEngine {
+public:
+  typedef Entry entry_type;
+
+  ListEngine() : head(NULL), count(0) {
+  }
+  ~ListEngine() {
+    clear();
+  }
+
+  bool insert(const Entry &entry) {
+    Node **link = &head;
+    while (*link != NULL) {
+      if ((*link)->entry.addr == entry.addr && (*link)->entry.len == entry.len) {
+        (*link)->entry = entry;
+        return false;
+      }
+      link = &(*link)->next;
+    }
+    *link = pool.create(entry);
+    count++;
+    return true;
+  }
+
+  bool erase(uint32_t addr, uint32_t len) {
+    for (Node **link = &head; *link != NULL; link = &(*link)->next) {
+      if ((*link)->entry.addr == addr && (*link)->entry.len == len) {
+        Node *node = *link;
+        *link = node->next;
+        pool.destroy(node);
+        count--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Entry *find(uint32_t addr, uint32_t len) {
+    for (Node *node = head; node != NULL; node = node->next) {
+      if (node->entry.addr == addr && node->entry.len == len) {
+        return &node->entry;
+      }
+    }
+    return NULL;
+  }
+
+  const Entry *lookup(uint32_t addr) const {
+    uint32_t key = rt_key(addr);
+    const Entry *best = NULL;
+    for (const Node *node = head; node != NULL; node = node->next) {
+      if ((best == NULL || node->entry.len > best->len) &&
+          ((key ^ rt_key(node->entry.addr)) & rt_mask(node->entry.len)) == 0) {
+        best = &node->entry;
+      }
+    }
+    return best;
+  }
+
+  void lookup_batch(const uint32_t *addrs, uint32_t n, const Entry **res) const {
+    for (uint32_t i = 0; i < n; i++) {
+      res[i] = lookup(addrs[i]);
+    }
+  }
+
+  template <class F>
+  void for_each(F f) const {
+    for (const Node *node = head; node != NULL; node = node->next) {
+      f(node->entry);
+    }
+  }
+
+  // entries 已排序去重，直接按顺序串成链表
+  void build(const Entry *entries, uint32_t n) {
+    clear();
+    Node **link = &head;
+    for (uint32_t i = 0; i < n; i++) {
+      *link = pool.create(entries[i]);
+      link = &(*link)->next;
+    }
+    count = n;
+  }
+
+  void clear() {
+    while (head != NULL) {
+      Node *next = head->next;
+      pool.destroy(head);
+      head = next;
+    }
+    count = 0;
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+  size_t allocated_bytes() const {
+    return pool.allocated_bytes();
+  }
+
+  size_t used_bytes() const {
+    return pool.used_bytes();
+  }
+
+private:
+  struct Node {
+    Entry entry;
+    Node *next;
+    Node(const Entry &e) : entry(e), next(NULL) {
+    }
+  };
+
+  Pool<Node> pool;
+  Node *head;
+  uint32_t count;
+
+  ListEngine(const ListEngine &);
+  ListEngine &operator=(const ListEngine &);
+};
+
+// 二叉 Trie，查询最多访问 33 个节点
+template <class Entry, template <class> class Pool = NodePool>
+class TrieEngine {
+public:
+  typedef Entry entry_type;
+
+  bool insert(const Entry &entry) {
+    return trie.insert(rt_key(entry.addr), entry.len, entry);
+  }
+
+  bool erase(uint32_t addr, uint32_t len) {
+    return trie.erase(rt_key(addr), len);
+  }
+
+  Entry *find(uint32_t addr, uint32_t len) {
+    return trie.find(rt_key(addr), len);
+  }
+
+  const Entry *lookup(uint32_t addr) const {
+    return trie.lookup(rt_key(addr));
+  }
+
+  void lookup_batch(const uint32_t *addrs, uint32_t n, const Entry **res) const {
+    for (uint32_t i = 0; i < n; i++) {
+      res[i] = lookup(addrs[i]);
+    }
+  }
+
+  template <class F>
+  void for_each(F f) const {
+    trie.for_each([&](uint32_t, uint32_t, const Entry &entry) { f(entry); });
+  }
+
+  void build(const Entry *entries, uint32_t n) {
+    clear();
+    for (uint32_t i = 0; i < n; i++) {
+      insert(entries[i]);
+    }
+  }
+
+  void clear() {
+    trie.clear();
+  }
+
+  uint32_t size() const {
+    return trie.size();
+  }
+
+  size_t allocated_bytes() const {
+    return trie.allocated_bytes();
+  }
+
+  size_t used_bytes() const {
+    return trie.used_bytes();
+  }
+
+private:
+  BinaryTrie<Entry, Pool> trie;
+};
+
+/*
+  DIR-24-8：tbl24 按地址的高 24 位直接索引，前缀长于 24 的部分放在 256 项一组的 tbl8 中。
+  表里存的是表项编号，最高位为 1 时表示低位是 tbl8 组号，0 表示没有路由。
+  另用一棵 BinaryTrie 记录 前缀 -> 编号，删除时用来找到需要回填的较短前缀。
+*/
+template <class Entry, template <class> class Pool = NodePool>
+class Dir248Engine {
+public:
+  typedef Entry entry_type;
+
+  Dir248Engine() : entries(1) {
+    tbl24 = alloc_tbl24();
+  }
+  ~Dir248Engine() {
+    free(tbl24);
+  }
+
+  bool insert(const Entry &entry) {
+    uint32_t key = rt_key(entry.addr) & rt_mask(entry.len);
+    uint32_t *old = prefixes.find(key, entry.len);
+    if (old != NULL) {
+      entries[*old] = entry;
+      return false;
+    }
+    uint32_t id;
+    if (!free_entries.empty()) {
+      id = free_entries.back();
+      free_entries.pop_back();
+      entries[id] = entry;
+    } else {
+      id = entries.size();
+      entries.push_back(entry);
+    }
+    prefixes.insert(key, entry.len, id);
+    fill(key, entry.len, id, 0);
+    return true;
+  }
+
+  bool erase(uint32_t addr, uint32_t len) {
+    uint32_t key = rt_key(addr) & rt_mask(len);
+    uint32_t *old = prefixes.find(key, len);
+    if (old == NULL) {
+      return false;
+    }
+    uint32_t id = *old;
+    const uint32_t *parent = len > 0 ? prefixes.lookup(key, len - 1) : NULL;
+    fill(key, len, parent != NULL ? *parent : 0, id);
+    prefixes.erase(key, len);
+    free_entries.push_back(id);
+    return true;
+  }
+
+  Entry *find(uint32_t addr, uint32_t len) {
+    uint32_t *id = prefixes.find(rt_key(addr) & rt_mask(len), len);
+    return id != NULL ? &entries[*id] : NULL;
+  }
+
+  const Entry *lookup(uint32_t addr) const {
+    uint32_t key = rt_key(addr);
+    uint32_t v = tbl24[key >> 8];
+    if (v & EXTENDED) {
+      v = tbl8[((v & ~EXTENDED) << 8) | (key & 0xFF)];
+    }
+    return v != 0 ? &entries[v] : NULL;
+  }
+
+  // 先把所有 tbl24 的访存发出去，再逐个解析，隐藏访存延迟
+  void lookup_batch(const uint32_t *addrs, uint32_t n, const Entry **res) const {
+    for (uint32_t i = 0; i < n; i++) {
+      __builtin_prefetch(&tbl24[rt_key(addrs[i]) >> 8]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      res[i] = lookup(addrs[i]);
+    }
+  }
+
+  template <class F>
+  void for_each(F f) const {
+    prefixes.for_each([&](uint32_t, uint32_t, uint32_t id) { f(entries[id]); });
+  }
+
+  void build(const Entry *entries, uint32_t n) {
+    clear();
+    for (uint32_t i = 0; i < n; i++) {
+      insert(entries[i]);
+    }
+  }
+
+  void clear() {
+    // 重新申请而不是 memset，避免把 64MB 全部变成实际占用的内存；先申请再释放，失败时表不变
+    uint32_t *fresh = alloc_tbl24();
+    free(tbl24);
+    tbl24 = fresh;
+    tbl8.clear();
+    free_groups.clear();
+    entries.resize(1);
+    free_entries.clear();
+    prefixes.clear();
+  }
+
+  uint32_t size() const {
+    return prefixes.size();
+  }
+
+  // tbl24 只计算实际写入过的部分难以统计，这里按整张表计入
+  size_t allocated_bytes() const {
+    return (1 << 24) * sizeof(uint32_t) + tbl8.capacity() * sizeof(uint32_t) +
+           entries.capacity() * sizeof(Entry) + prefixes.allocated_bytes();
+  }
+
+  size_t used_bytes() const {
+    return (1 << 24) * sizeof(uint32_t) + (tbl8.size() - (free_groups.size() << 8)) * sizeof(uint32_t) +
+           (entries.size() - free_entries.size()) * sizeof(Entry) + prefixes.used_bytes();
+  }
+
+private:
+  static const uint32_t EXTENDED = 0x80000000;
+
+  // 64MB，calloc 得到的零页在第一次写入前不占用物理内存；申请失败与 vector 一样抛出 bad_alloc
+  static uint32_t *alloc_tbl24() {
+    uint32_t *table = (uint32_t *)calloc(1 << 24, sizeof(uint32_t));
+    if (table == NULL) {
+      throw std::bad_alloc();
+    }
+    return table;
+  }
+
+  // 插入时 old 为 0：覆盖范围内所有比 len 短的（或空的）位置都改为 id；
+  // 删除时 old 为被删除的编号：范围内所有等于 old 的位置改为 id
+  void fill(uint32_t key, uint32_t len, uint32_t id, uint32_t old) {
+    if (len <= 24) {
+      uint32_t begin = key >> 8;
+      uint32_t end = begin + (1 << (24 - len));
+      for (uint32_t s = begin; s < end; s++) {
+        if (tbl24[s] & EXTENDED) {
+          uint32_t *group = &tbl8[(tbl24[s] & ~EXTENDED) << 8];
+          for (uint32_t j = 0; j < 256; j++) {
+            replace(&group[j], len, id, old);
+          }
+        } else {
+          replace(&tbl24[s], len, id, old);
+        }
+      }
+      return;
+    }
+    uint32_t s = key >> 8;
+    if (!(tbl24[s] & EXTENDED)) {
+      uint32_t g;
+      if (!free_groups.empty()) {
+        g = free_groups.back();
+        free_groups.pop_back();
+      } else {
+        g = tbl8.size() >> 8;
+        tbl8.resize(tbl8.size() + 256);
+      }
+      std::fill(tbl8.begin() + (g << 8), tbl8.begin() + (g << 8) + 256, tbl24[s]);
+      tbl24[s] = EXTENDED | g;
+    }
+    uint32_t g = tbl24[s] & ~EXTENDED;
+    uint32_t *group = &tbl8[g << 8];
+    uint32_t begin = key & 0xFF;
+    uint32_t end = begin + (1 << (32 - len));
+    for (uint32_t j = begin; j < end; j++) {
+      replace(&group[j], len, id, old);
+    }
+    // 组内只剩下不长于 24 的同一条路由时收回这个组
+    if (old != 0) {
+      for (uint32_t j = 1; j < 256; j++) {
+        if (group[j] != group[0]) {
+          return;
+        }
+      }
+      if (group[0] == 0 || entries[group[0]].len <= 24) {
+        tbl24[s] = group[0];
+        free_groups.push_back(g);
+      }
+    }
+  }
+
+  void replace(uint32_t *slot, uint32_t len, uint32_t id, uint32_t old) {
+    if (old != 0) {
+      if (*slot == old) {
+        *slot = id;
+      }
+    } else if (*slot == 0 || entries[*slot].len < len) {
+      *slot = id;
+    }
+  }
+
+  uint32_t *tbl24;
+  std::vector<uint32_t> tbl8;
+  std::vector<uint32_t> free_groups;
+  std::vector<Entry> entries; // 0 号不使用
+  std::vector<uint32_t> free_entries;
+  BinaryTrie<uint32_t, Pool> prefixes;
+
+  Dir248Engine(const Dir248Engine &);
+  Dir248Engine &operator=(const Dir248Engine &);
+};
+
+/*
+  路径压缩的二叉 Trie：只有一个孩子且本身不是前缀的节点被省略，
+  每个节点记录完整的 key 和 len，查询时比较跳过的位。节点数不超过表项数的两倍。
+*/
+template <class Entry, template <class> class Pool = NodePool>
+class PatriciaEngine {
+public:
+  typedef Entry entry_type;
+
+  PatriciaEngine() : root(NULL), count(0) {
+  }
+  ~PatriciaEngine() {
+    clear();
+  }
+
+  bool insert(const Entry &entry) {
+    uint32_t key = rt_key(entry.addr) & rt_mask(entry.len);
+    uint32_t len = entry.len;
+    Node **link = &root;
+    while (true) {
+      Node *node = *link;
+      if (node == NULL) {
+        *link = pool.create(key, len, true, entry);
+        count++;
+        return true;
+      }
+      uint32_t common = common_len(node, key, len);
+      if (common == node->len) {
+        if (len == node->len) {
+          bool added = !node->valid;
+          node->valid = true;
+          node->entry = entry;
+          count += added;
+          return added;
+        }
+        link = &node->child[rt_bit(key, node->len)];
+        continue;
+      }
+      // 在 common 位处分叉
+      Node *split;
+      if (common == len) {
+        split = pool.create(key, len, true, entry);
+      } else {
+        split = pool.create(key & rt_mask(common), common, false, entry);
+        split->child[rt_bit(key, common)] = pool.create(key, len, true, entry);
+      }
+      split->child[rt_bit(node->key, common)] = node;
+      *link = split;
+      count++;
+      return true;
+    }
+  }
+
+  bool erase(uint32_t addr, uint32_t len) {
+    uint32_t key = rt_key(addr) & rt_mask(len);
+    Node **parent_link = NULL;
+    Node **link = &root;
+    while (*link != NULL && (*link)->len < len && common_len(*link, key, len) == (*link)->len) {
+      parent_link = link;
+      link = &(*link)->child[rt_bit(key, (*link)->len)];
+    }
+    Node *node = *link;
+    if (node == NULL || node->len != len || node->key != key || !node->valid) {
+      return false;
+    }
+    node->valid = false;
+    count--;
+    if (node->child[0] != NULL && node->child[1] != NULL) {
+      return true;
+    }
+    *link = node->child[0] != NULL ? node->child[0] : node->child[1];
+    pool.destroy(node);
+    // 父节点可能只剩一个孩子，如果它本身不是前缀也要去掉
+    if (parent_link != NULL) {
+      Node *parent = *parent_link;
+      if (!parent->valid && (parent->child[0] == NULL || parent->child[1] == NULL)) {
+        *parent_link = parent->child[0] != NULL ? parent->child[0] : parent->child[1];
+        pool.destroy(parent);
+      }
+    }
+    return true;
+  }
+
+  Entry *find(uint32_t addr, uint32_t len) {
+    uint32_t key = rt_key(addr) & rt_mask(len);
+    Node *node = root;
+    while (node != NULL && node->len < len && common_len(node, key, len) == node->len) {
+      node = node->child[rt_bit(key, node->len)];
+    }
+    if (node == NULL || node->len != len || node->key != key || !node->valid) {
+      return NULL;
+    }
+    return &node->entry;
+  }
+
+  const Entry *lookup(uint32_t addr) const {
+    uint32_t key = rt_key(addr);
+    const Node *node = root;
+    const Entry *best = NULL;
+    while (node != NULL && ((key ^ node->key) & rt_mask(node->len)) == 0) {
+      if (node->valid) {
+        best = &node->entry;
+      }
+      if (node->len == 32) {
+        break;
+      }
+      node = node->child[rt_bit(key, node->len)];
+    }
+    return best;
+  }
+
+  void lookup_batch(const uint32_t *addrs, uint32_t n, const Entry **res) const {
+    for (uint32_t i = 0; i < n; i++) {
+      res[i] = lookup(addrs[i]);
+    }
+  }
+
+  template <class F>
+  void for_each(F f) const {
+    visit(root, f);
+  }
+
+  void build(const Entry *entries, uint32_t n) {
+    clear();
+    for (uint32_t i = 0; i < n; i++) {
+      insert(entries[i]);
+    }
+  }
+
+  void clear() {
+    destroy(root);
+    root = NULL;
+    count = 0;
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+  size_t allocated_bytes() const {
+    return pool.allocated_bytes();
+  }
+
+  size_t used_bytes() const {
+    return pool.used_bytes();
+  }
+
+private:
+  struct Node {
+    uint32_t key;
+    uint32_t len;
+    bool valid;
+    Entry entry;
+    Node *child[2];
+    Node(uint32_t k, uint32_t l, bool v, const Entry &e) : key(k), len(l), valid(v), entry(e) {
+      child[0] = child[1] = NULL;
+    }
+  };
+
+  // node 的前缀与 (key, len) 的公共前缀长度
+  static uint32_t common_len(const Node *node, uint32_t key, uint32_t len) {
+    uint32_t diff = node->key ^ key;
+    uint32_t common = diff == 0 ? 32 : __builtin_clz(diff);
+    return std::min(common, std::min(len, node->len));
+  }
+
+  template <class F>
+  static void visit(const Node *node, F &f) {
+    if (node == NULL) {
+      return;
+    }
+    if (node->valid) {
+      f(node->entry);
+    }
+    visit(node->child[0], f);
+    visit(node->child[1], f);
+  }
+
+  void destroy(Node *node) {
+    if (node == NULL) {
+      return;
+    }
+    destroy(node->child[0]);
+    destroy(node->child[1]);
+    pool.destroy(node);
+  }
+
+  Pool<Node> pool;
+  Node *root;
+  uint32_t count;
+
+  PatriciaEngine(const PatriciaEngine &);
+  PatriciaEngine &operator=(const PatriciaEngine &);
+};
+
+template <class Engine>
+class RoutingTable {
+public:
+  typedef typename Engine::entry_type Entry;
+
+  /**
+   * @brief 插入一条表项，已经存在 addr 和 len 都相同的表项时替换掉
+   * @return 新增返回 true ，替换返回 false
+   */
+  bool insert(const Entry &entry) {
+    return engine.insert(entry);
+  }
+
+  /**
+   * @brief 按 addr 和 len 删除一条表项
+   * @return 存在返回 true
+   */
+  bool erase(uint32_t addr, uint32_t len) {
+    return engine.erase(addr, len);
+  }
+
+  // 精确查找，不存在返回 NULL
+  Entry *find(uint32_t addr, uint32_t len) {
+    return engine.find(addr, len);
+  }
+
+  /**
+   * @brief 最长前缀匹配
+   * @param addr 大端序地址
+   * @return 匹配的表项，没有则返回 NULL ，指针在下一次修改路由表之前有效
+   */
+  const Entry *query(uint32_t addr) const {
+    return engine.lookup(addr);
+  }
+
+  // 对 addrs 中的 n 个地址分别做最长前缀匹配，结果写入 res
+  void query_batch(const uint32_t *addrs, uint32_t n, const Entry **res) const {
+    engine.lookup_batch(addrs, n, res);
+  }
+
+  // 遍历所有表项，f(const Entry &)
+  template <class F>
+  void for_each(F f) const {
+    engine.for_each(f);
+  }
+
+  // 遍历出端口为 if_index 的表项
+  template <class F>
+  void for_each_interface(uint32_t if_index, F f) const {
+    engine.for_each([&](const Entry &entry) {
+      if (entry.if_index == if_index) {
+        f(entry);
+      }
+    });
+  }
+
+  /**
+   * @brief 批量建表，替换掉原有的全部表项
+   * @param entries 表项数组，可以无序，也可以有重复，会被原地重排
+   * @param n 表项个数
+   *
+   * 重复项保留数组中靠后的一项，与逐条 insert 的替换语义一致。
+   */
+  void build(Entry *entries, uint32_t n) {
+    std::stable_sort(entries, entries + n, entry_less);
+    uint32_t m = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      if (i + 1 < n && entries[i].addr == entries[i + 1].addr && entries[i].len == entries[i + 1].len) {
+        continue;
+      }
+      entries[m++] = entries[i];
+    }
+    engine.build(entries, m);
+  }
+
+  void clear() {
+    engine.clear();
+  }
+
+  uint32_t size() const {
+    return engine.size();
+  }
+
+  // 路由表申请的内存和其中正在使用的部分，单位字节
+  size_t allocated_bytes() const {
+    return engine.allocated_bytes();
+  }
+
+  size_t used_bytes() const {
+    return engine.used_bytes();
+  }
+
+private:
+  static bool entry_less(const Entry &a, const Entry &b) {
+    uint32_t ka = rt_key(a.addr), kb = rt_key(b.addr);
+    if (ka != kb) {
+      return ka < kb;
+    }
+    return a.len < b.len;
+  }
+
+  Engine engine;
+};
+
+#endif
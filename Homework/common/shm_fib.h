@@ -0,0 +1,359 @@
+#ifndef SHM_FIB_H
+#define SHM_FIB_H
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "routing_table.h"
+
+/*
+  共享内存中的转发表，一个控制进程写，多个数据面进程只读映射、无锁查询。
+  数据面进程重启时映射同一段共享内存就立即拿到完整的路由和邻居，不需要等控制面。
+
+  路由以区间表的形式保存：最长前缀匹配把地址空间切成若干段，每段的转发动作相同，
+  starts 是各段起点（主机序，starts[0] 为 0），查询就是找最后一个不大于目的地址的起点。
+  base 按地址的高 16 位预先算好每块所在的段，二分查找只在块内进行，通常只有几段。
+  相同的动作只保存一份，段里记录动作的编号，编号 0 表示没有路由。
+
+  路由表有两份，写入者总是重建不在使用的一份，写完后切换 active 。每份有自己的序号
+  （seqlock）：写之前置为奇数，写完加一变为偶数；读者先读序号，查询，再确认序号
+  没有变，变了（写入者在读者查询期间连续发布了两次，又开始写这一份）就重试。
+  邻居表是开放寻址的定长哈希表，写入很少，整张表用一个序号保护。
+
+  Action 必须可以按字节复制和比较，例如 NextHopGroup 。
+*/
+
+#define SHM_FIB_MAGIC 0x42494652 // "RFIB"
+#define SHM_FIB_PORTS 16
+#define SHM_FIB_MAX_RANGES (1 << 20)
+#define SHM_FIB_MAX_ACTIONS 65536
+#define SHM_FIB_NEIGHBORS 4096 // 2 的幂
+
+// 发布时的一条路由，key 为主机序
+template <class Action>
+struct ShmFibPrefix {
+  uint32_t key;
+  uint32_t len;
+  Action action;
+};
+
+struct ShmFibNeighbor {
+  uint32_t addr; // 大端序，0 表示空位
+  uint32_t if_index;
+  uint8_t mac[6];
+  uint8_t pad[2];
+};
+
+template <class Action>
+class ShmFib {
+public:
+  ShmFib() : seg(NULL), fd(-1) {}
+
+  ~ShmFib() {
+    if (seg != NULL) {
+      munmap(seg, sizeof(Segment));
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  /**
+   * @brief 控制进程创建（或重新使用）共享内存，之前的内容保留，数据面在控制进程重启期间照常转发
+   * @param name 共享内存的名字，如 "/router-fib"
+   * @return 成功返回 true
+   */
+  bool create(const char *name) {
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(Segment)) != 0) {
+      return false;
+    }
+    void *p = mmap(NULL, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    seg = (Segment *)p;
+    if (seg->magic != SHM_FIB_MAGIC || seg->size != sizeof(Segment)) {
+      // 新建的内存全为零，两份路由表都是空的
+      seg->size = sizeof(Segment);
+      __atomic_store_n(&seg->magic, SHM_FIB_MAGIC, __ATOMIC_RELEASE);
+    } else {
+      // 上一个写入者可能在写到一半时退出，留下奇数的序号，读者会一直等下去；
+      // 没有在使用的那份本来就不会被读到，当前的一份和邻居表在写入时只改动一项，都可以直接用
+      for (uint32_t i = 0; i < 2; i++) {
+        round_even(&seg->copies[i].seq);
+      }
+      round_even(&seg->neighbor_seq);
+    }
+    return true;
+  }
+
+  /**
+   * @brief 数据面进程只读映射共享内存
+   * @return 控制进程已经创建过且布局相同时返回 true
+   */
+  bool open(const char *name) {
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+      return false;
+    }
+    void *p = mmap(NULL, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    seg = (Segment *)p;
+    return __atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == SHM_FIB_MAGIC && seg->size == sizeof(Segment);
+  }
+
+  // 写入者：各端口的地址（大端序），数据面据此判断报文是否发给路由器自己
+  void set_ports(const uint32_t *addrs, uint32_t n) {
+    for (uint32_t i = 0; i < n && i < SHM_FIB_PORTS; i++) {
+      __atomic_store_n(&seg->addrs[i], addrs[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&seg->ports, n < SHM_FIB_PORTS ? n : SHM_FIB_PORTS, __ATOMIC_RELEASE);
+  }
+
+  uint32_t ports() const {
+    return __atomic_load_n(&seg->ports, __ATOMIC_ACQUIRE);
+  }
+
+  uint32_t port_addr(uint32_t i) const {
+    return __atomic_load_n(&seg->addrs[i], __ATOMIC_RELAXED);
+  }
+
+  // 已经发布的次数，数据面可以据此判断控制面是否还在更新
+  uint32_t generation() const {
+    return __atomic_load_n(&seg->generation, __ATOMIC_ACQUIRE);
+  }
+
+  /**
+   * @brief 写入者：用一组路由替换整张转发表，数组会被原地排序
+   * @return 段数或动作数超出容量时返回 false ，原来的表不变
+   */
+  bool publish(std::vector<ShmFibPrefix<Action> > &prefixes) {
+    std::sort(prefixes.begin(), prefixes.end(), [](const ShmFibPrefix<Action> &a, const ShmFibPrefix<Action> &b) {
+      return a.key != b.key ? a.key < b.key : a.len < b.len;
+    });
+    uint32_t active = __atomic_load_n(&seg->active, __ATOMIC_RELAXED);
+    Copy &c = seg->copies[active ^ 1];
+    // 写时为奇数、写完为偶数，与原来序号的奇偶无关
+    uint32_t seq = __atomic_load_n(&c.seq, __ATOMIC_RELAXED) | 1;
+    __atomic_store_n(&c.seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    bool ok = fill(c, prefixes);
+    __atomic_store_n(&c.seq, seq + 1, __ATOMIC_RELEASE);
+    if (ok) {
+      __atomic_store_n(&seg->active, active ^ 1, __ATOMIC_RELEASE);
+      __atomic_store_n(&seg->generation, seg->generation + 1, __ATOMIC_RELEASE);
+    }
+    return ok;
+  }
+
+  /**
+   * @brief 最长前缀匹配
+   * @param addr 目的地址，大端序
+   * @param action 查到时写入
+   * @return 有路由则返回 true
+   */
+  bool lookup(uint32_t addr, Action *action) const {
+    uint32_t key = rt_key(addr);
+    while (true) {
+      const Copy &c = seg->copies[__atomic_load_n(&seg->active, __ATOMIC_ACQUIRE) & 1];
+      uint32_t seq = __atomic_load_n(&c.seq, __ATOMIC_ACQUIRE);
+      if (seq & 1) {
+        continue;
+      }
+      // 写到一半的内容可能不一致，下标先检查范围再使用，结果由序号决定是否采用
+      uint32_t n = __atomic_load_n(&c.ranges, __ATOMIC_RELAXED);
+      uint32_t lo = c.base[key >> 16], hi = c.base[(key >> 16) + 1] + 1;
+      uint32_t id = 0;
+      if (n <= SHM_FIB_MAX_RANGES && lo < hi && hi <= n) {
+        // 找 [lo, hi) 中最后一个不大于 key 的起点，starts[lo] 总是不大于块内的地址
+        while (hi - lo > 1) {
+          uint32_t mid = (lo + hi) / 2;
+          if (c.starts[mid] <= key) {
+            lo = mid;
+          } else {
+            hi = mid;
+          }
+        }
+        id = c.range_action[lo];
+        if (id < SHM_FIB_MAX_ACTIONS) {
+          *action = c.actions[id];
+        }
+      }
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&c.seq, __ATOMIC_RELAXED) == seq) {
+        return id != 0 && id < SHM_FIB_MAX_ACTIONS;
+      }
+    }
+  }
+
+  /**
+   * @brief 写入者：插入或更新一个邻居的 MAC 地址
+   * @return 表满时返回 false
+   */
+  bool set_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac) {
+    uint32_t mask = SHM_FIB_NEIGHBORS - 1;
+    uint32_t i = neighbor_hash(addr, if_index) & mask;
+    for (uint32_t probes = 0; probes < SHM_FIB_NEIGHBORS; probes++, i = (i + 1) & mask) {
+      ShmFibNeighbor &slot = seg->neighbors[i];
+      if (slot.addr == 0 || (slot.addr == addr && slot.if_index == if_index)) {
+        uint32_t seq = __atomic_load_n(&seg->neighbor_seq, __ATOMIC_RELAXED) | 1;
+        __atomic_store_n(&seg->neighbor_seq, seq, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        slot.if_index = if_index;
+        memcpy(slot.mac, mac, 6);
+        slot.addr = addr;
+        __atomic_store_n(&seg->neighbor_seq, seq + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief 查询邻居的 MAC 地址
+   * @return 查到则返回 true
+   */
+  bool neighbor(uint32_t addr, uint32_t if_index, uint8_t *mac) const {
+    uint32_t mask = SHM_FIB_NEIGHBORS - 1;
+    while (true) {
+      uint32_t seq = __atomic_load_n(&seg->neighbor_seq, __ATOMIC_ACQUIRE);
+      if (seq & 1) {
+        continue;
+      }
+      bool found = false;
+      uint32_t i = neighbor_hash(addr, if_index) & mask;
+      for (uint32_t probes = 0; probes < SHM_FIB_NEIGHBORS && seg->neighbors[i].addr != 0; probes++, i = (i + 1) & mask) {
+        if (seg->neighbors[i].addr == addr && seg->neighbors[i].if_index == if_index) {
+          memcpy(mac, seg->neighbors[i].mac, 6);
+          found = true;
+          break;
+        }
+      }
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&seg->neighbor_seq, __ATOMIC_RELAXED) == seq) {
+        return found;
+      }
+    }
+  }
+
+private:
+  struct Copy {
+    uint32_t seq; // 奇数表示正在写
+    uint32_t ranges; // 段数
+    uint32_t base[65537]; // 高 16 位为 h 的地址所在的段在 [base[h], base[h + 1]] 中
+    uint32_t starts[SHM_FIB_MAX_RANGES];
+    uint32_t range_action[SHM_FIB_MAX_RANGES];
+    uint32_t nactions;
+    Action actions[SHM_FIB_MAX_ACTIONS];
+  };
+
+  struct Segment {
+    uint32_t magic;
+    uint32_t size; // sizeof(Segment) ，布局不同的进程不会互相误读
+    uint32_t active; // 当前使用的一份
+    uint32_t generation;
+    uint32_t ports;
+    uint32_t addrs[SHM_FIB_PORTS];
+    uint32_t neighbor_seq;
+    ShmFibNeighbor neighbors[SHM_FIB_NEIGHBORS];
+    Copy copies[2];
+  };
+
+  Segment *seg;
+  int fd;
+  std::vector<uint32_t> out_starts; // 发布时的临时空间
+  std::vector<uint32_t> out_actions;
+
+  static void round_even(uint32_t *seq) {
+    uint32_t v = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    if (v & 1) {
+      __atomic_store_n(seq, v + 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  static uint32_t neighbor_hash(uint32_t addr, uint32_t if_index) {
+    return (addr ^ (if_index * 0x9E3779B9)) * 0x85EBCA6B >> 16;
+  }
+
+  uint32_t action_id(Copy &c, const Action &action) {
+    for (uint32_t i = 1; i < c.nactions; i++) {
+      if (memcmp(&c.actions[i], &action, sizeof(Action)) == 0) {
+        return i;
+      }
+    }
+    if (c.nactions >= SHM_FIB_MAX_ACTIONS) {
+      return SHM_FIB_MAX_ACTIONS;
+    }
+    c.actions[c.nactions] = action;
+    return c.nactions++;
+  }
+
+  // 添加一段，起点相同时后来的覆盖之前的，动作与前一段相同时合并
+  void emit(uint64_t start, uint32_t id) {
+    if (!out_starts.empty() && out_starts.back() == start) {
+      out_starts.pop_back();
+      out_actions.pop_back();
+    }
+    if (out_actions.empty() || out_actions.back() != id) {
+      out_starts.push_back((uint32_t)start);
+      out_actions.push_back(id);
+    }
+  }
+
+  // 按地址顺序扫描排好序的前缀，栈中是包含当前位置的前缀，栈顶最长
+  bool fill(Copy &c, const std::vector<ShmFibPrefix<Action> > &prefixes) {
+    c.nactions = 1;
+    out_starts.clear();
+    out_actions.clear();
+    std::vector<std::pair<uint64_t, uint32_t> > stack(1, std::make_pair(1ULL << 32, 0));
+    emit(0, 0);
+    for (size_t i = 0; i < prefixes.size(); i++) {
+      uint64_t start = prefixes[i].key;
+      while (start >= stack.back().first) {
+        uint64_t end = stack.back().first;
+        stack.pop_back();
+        emit(end, stack.back().second);
+      }
+      uint32_t id = action_id(c, prefixes[i].action);
+      if (id >= SHM_FIB_MAX_ACTIONS) {
+        return false;
+      }
+      emit(start, id);
+      stack.push_back(std::make_pair(start + (1ULL << (32 - prefixes[i].len)), id));
+    }
+    while (stack.size() > 1) {
+      uint64_t end = stack.back().first;
+      stack.pop_back();
+      if (end < (1ULL << 32)) {
+        emit(end, stack.back().second);
+      }
+    }
+    uint32_t n = out_starts.size();
+    if (n > SHM_FIB_MAX_RANGES) {
+      return false;
+    }
+    memcpy(c.starts, out_starts.data(), n * sizeof(uint32_t));
+    memcpy(c.range_action, out_actions.data(), n * sizeof(uint32_t));
+    // base[h] 是包含 h << 16 的段，base[65536] 为最后一段
+    uint32_t r = 0;
+    for (uint32_t h = 0; h < 65536; h++) {
+      while (r + 1 < n && c.starts[r + 1] <= (h << 16)) {
+        r++;
+      }
+      c.base[h] = r;
+    }
+    c.base[65536] = n - 1;
+    c.ranges = n;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+  分层时间轮，时间单位为毫秒。
+  共 LEVELS 层，每层 SLOTS 个槽，第 l 层的一个槽跨 SLOTS^l 毫秒。定时器按到期时间
+  与当前时间的差放入能容纳它的最低一层，上层的槽在转到时整体下放（cascade）到下层，
+  到第 0 层的槽时到期。添加、修改、取消都是 O(1)，推进时只处理到期或下放的定时器，
+  与定时器总数无关；某几层为空时直接跳到下一次需要下放的时刻。
+  超过最高层范围的定时器放在最高层，下放时重新放置，直到真正到期。
+*/
+template <class Value>
+class TimerWheel {
+public:
+  TimerWheel() : free_head(0), now(0), count(0) {
+    for (uint32_t l = 0; l < LEVELS; l++) {
+      level_count[l] = 0;
+      for (uint32_t s = 0; s < SLOTS; s++) {
+        heads[l][s] = 0;
+      }
+    }
+    nodes.resize(1); // 编号 0 表示没有定时器
+  }
+
+  // 设置当前时间，只应在添加第一个定时器之前调用
+  void reset(uint64_t time) {
+    now = time;
+  }
+
+  uint64_t time() const {
+    return now;
+  }
+
+  uint32_t size() const {
+    return count;
+  }
+
+  // 添加一个在 expire 时刻到期的定时器，返回编号，到期或取消后编号会被复用
+  uint32_t add(uint64_t expire, const Value &value) {
+    uint32_t id;
+    if (free_head != 0) {
+      id = free_head;
+      free_head = nodes[id].next;
+    } else {
+      id = nodes.size();
+      nodes.push_back(Node());
+    }
+    nodes[id].expire = expire;
+    nodes[id].value = value;
+    place(id, now + 1);
+    count++;
+    return id;
+  }
+
+  // 修改到期时间，路由刷新时使用
+  void modify(uint32_t id, uint64_t expire) {
+    unlink(id);
+    nodes[id].expire = expire;
+    place(id, now + 1);
+  }
+
+  void cancel(uint32_t id) {
+    unlink(id);
+    nodes[id].level = FREE;
+    nodes[id].next = free_head;
+    free_head = id;
+    count--;
+  }
+
+  // 推进到 time，对每个到期的定时器调用 f(value)，回调中可以添加或取消定时器
+  template <class F>
+  void advance(uint64_t time, F f) {
+    while (now < time) {
+      now = next_tick(time);
+      cascade();
+      uint32_t &head = heads[0][now & (SLOTS - 1)];
+      while (head != 0) {
+        uint32_t id = head;
+        unlink(id);
+        if (nodes[id].expire > now) {
+          // 超出最高层范围的定时器
+          place(id, now + 1);
+          continue;
+        }
+        Value value = nodes[id].value;
+        nodes[id].level = FREE;
+        nodes[id].next = free_head;
+        free_head = id;
+        count--;
+        f(value);
+      }
+    }
+  }
+
+  // 下一次需要调用 advance 的时刻，不晚于 limit
+  uint64_t next_expire(uint64_t limit) const {
+    uint64_t next = limit;
+    if (level_count[0] > 0) {
+      for (uint64_t t = now + 1; t <= now + SLOTS && t < next; t++) {
+        if (heads[0][t & (SLOTS - 1)] != 0) {
+          next = t;
+          break;
+        }
+      }
+    }
+    // 最低的非空上层下一次下放的时刻
+    for (uint32_t l = 1; l < LEVELS; l++) {
+      if (level_count[l] > 0) {
+        uint64_t t = ((now >> (BITS * l)) + 1) << (BITS * l);
+        return t < next ? t : next;
+      }
+    }
+    return next;
+  }
+
+private:
+  static const uint32_t BITS = 6;
+  static const uint32_t SLOTS = 1 << BITS;
+  static const uint32_t LEVELS = 5;
+  static const uint8_t FREE = 0xFF;
+
+  struct Node {
+    uint64_t expire;
+    uint32_t prev, next;
+    uint8_t level, slot;
+    Value value;
+    Node() : expire(0), prev(0), next(0), level(FREE), slot(0), value() {
+    }
+  };
+
+  // 跳过空的层：最低的非空层是 l 时，在下一个 SLOTS^l 的整数倍之前什么都不会发生
+  uint64_t next_tick(uint64_t time) const {
+    for (uint32_t l = 0; l < LEVELS; l++) {
+      if (level_count[l] > 0) {
+        uint64_t t = l == 0 ? now + 1 : ((now >> (BITS * l)) + 1) << (BITS * l);
+        return t < time ? t : time;
+      }
+    }
+    return time;
+  }
+
+  // now 是某层槽宽的整数倍时，把上一层对应的槽下放
+  void cascade() {
+    for (uint32_t l = 1; l < LEVELS; l++) {
+      if ((now >> (BITS * (l - 1))) & (SLOTS - 1)) {
+        break;
+      }
+      uint32_t &head = heads[l][(now >> (BITS * l)) & (SLOTS - 1)];
+      while (head != 0) {
+        uint32_t id = head;
+        unlink(id);
+        place(id, now);
+      }
+    }
+  }
+
+  // 到期时间早于 earliest 的按 earliest 放置。now 这个 tick 已经处理过，
+  // 只有下放时（第 0 层的槽还没处理）earliest 可以是 now
+  void place(uint32_t id, uint64_t earliest) {
+    Node &node = nodes[id];
+    uint64_t expire = node.expire > earliest ? node.expire : earliest;
+    uint64_t delta = expire - now;
+    uint32_t l = 0;
+    while (l + 1 < LEVELS && delta >= ((uint64_t)1 << (BITS * (l + 1)))) {
+      l++;
+    }
+    if (delta >= ((uint64_t)1 << (BITS * LEVELS))) {
+      expire = now + ((uint64_t)1 << (BITS * LEVELS)) - 1;
+    }
+    uint32_t s = (expire >> (BITS * l)) & (SLOTS - 1);
+    node.level = l;
+    node.slot = s;
+    node.prev = 0;
+    node.next = heads[l][s];
+    if (node.next != 0) {
+      nodes[node.next].prev = id;
+    }
+    heads[l][s] = id;
+    level_count[l]++;
+  }
+
+  void unlink(uint32_t id) {
+    Node &node = nodes[id];
+    if (node.prev != 0) {
+      nodes[node.prev].next = node.next;
+    } else {
+      heads[node.level][node.slot] = node.next;
+    }
+    if (node.next != 0) {
+      nodes[node.next].prev = node.prev;
+    }
+    level_count[node.level]--;
+  }
+
+  std::vector<Node> nodes;
+  uint32_t free_head; // 空闲编号链表，经 Node::next 相连
+  uint32_t heads[LEVELS][SLOTS];
+  uint32_t level_count[LEVELS];
+  uint64_t now; // 已经处理过的最后一个 tick
+  uint32_t count;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "router.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include "routing_table.h"
 
 
 /*
@@ -17,18 +18,11 @@
   保证 addr 仅最低 len 位可能出现非零。
   当 nexthop 为零时这是一条直连路由。
   你可以在全局变量中把路由表以一定的数据结构格式保存下来。
-*/
 
-struct RoutingList {
-  RoutingTableEntry entry;
-  RoutingList * next = NULL;
-  RoutingList() {
-  }
-  RoutingList(RoutingTableEntry e) {
-    entry = e;
-  }
-} first;
+  路由表的数据结构与 router 共用，见 Homework/common/routing_table.h ，编译时用 ENGINE 选择。
+*/
 
+RoutingTable<ROUTING_ENGINE<RoutingTableEntry> > table;
 
 /**
  * @brief 插入/删除一条路由表表项
@@ -39,29 +33,10 @@ struct RoutingList {
  * 删除时按照 addr 和 len 匹配。
  */
 void update(bool insert, RoutingTableEntry entry) {
-  // TODO:
-  RoutingList * before;
-  RoutingList * now = &first;
-  RoutingList * next = first.next;
-  while (next != NULL) {
-    before = now;
-    now = next;
-    next = now->next;
-    if (now->entry.addr == entry.addr && now->entry.len == entry.len){
-      if (insert) {
-        now->entry.if_index = entry.if_index;
-        now->entry.nexthop = entry.nexthop;
-      }
-      else {
-        before->next = next;
-        delete now;
-      }
-      return;
-    }
-  }
   if (insert) {
-    RoutingList * newRouting = new RoutingList(entry);
-    now->next = newRouting;
+    table.insert(entry);
+  } else {
+    table.erase(entry.addr, entry.len);
   }
 }
 
@@ -73,24 +48,11 @@ void update(bool insert, RoutingTableEntry entry) {
  * @return 查到则返回 true ，没查到则返回 false
  */
 bool query(uint32_t addr, uint32_t *nexthop, uint32_t *if_index) {
-  // TODO:
-  
-  bool res = false;
-  RoutingList * now = &first;
-  RoutingList * next = first.next;
-  uint32_t max_len = 0;
-  while (next != NULL) {
-    now = next;
-    next = now->next;
-    if (now->entry.len > max_len) {
-      uint32_t mask = (uint32_t)(((uint64_t)(0x0000000000000001) << now->entry.len) - 1);
-      if ((addr & mask) == (now->entry.addr & mask)) {
-        *nexthop = now->entry.nexthop;
-        *if_index = now->entry.if_index;
-        max_len = now->entry.len;
-        res = true;
-      }
-    }
+  const RoutingTableEntry *entry = table.query(addr);
+  if (entry == NULL) {
+    return false;
   }
-  return res;
+  *nexthop = entry->nexthop;
+  *if_index = entry->if_index;
+  return true;
 }
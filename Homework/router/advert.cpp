@@ -0,0 +1,511 @@
+#include "rip.h"
+#include "router.h"
+#include "router_hal.h"
+#include "prefix_hash.h"
+#include "timer.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+/*
+  每个端口要通告出去的 RIP 表项。
+  出端口就是这个端口的路由（等价多路径中有一条从这个端口出去即可）：直连/静态路由
+  按水平分割不向它通告，从这个端口的邻居学到的路由按毒性逆转以 metric 16 通告
+  （RFC2453 3.4.3）。其余路由以 RipEntry 的形式
+  连续存放，顺序就是发送的顺序。路由表每次变化时由 update 调用 advert_update 同步修改，
+  定时发送或回应请求时只需要把现成的表项按 RIP_MAX_ENTRY 一组拷贝出来，不再遍历路由表。
+
+  每组表项组装好的 IP/UDP/RIP 包也缓存下来，表项变化时只把它所在的组标记为脏，
+  发送时只重新组装脏的组，路由稳定时定时更新直接发送缓存的包。
+
+  另外记录上次触发更新（或定时更新）之后变化过的表项，触发更新只发送这些表项，
+  见 RFC2453 3.10.1 。同一个前缀多次变化只保留最后一次。
+
+  可选的路由汇总（make SUMMARIZE=1 ，或调用 advert_set_summarize）：
+  通告前把 metric 和 nexthop 都相同的兄弟前缀合并成父前缀，再去掉被 metric 和 nexthop
+  都相同的最近上级前缀覆盖的前缀。邻居按最长前缀匹配得到的结果与不汇总时相同：
+  出端口就是这个端口的路由（邻居自己有或经过这里）和 metric 16 的路由都挡住向上的覆盖，
+  父前缀是从这个端口学到的则不合并。汇总结果在表项变化后访问时重新计算，
+  与上一次的结果比较得到触发更新要发送的表项，消失的前缀以 metric 16 发送一次。
+*/
+
+extern uint32_t assemble(const RipPacket *rip, uint8_t *buffer);
+extern uint32_t assembleUDP(uint8_t *buffer, uint32_t riplen);
+extern uint32_t assembleIP(uint8_t *buffer, uint32_t udplen, uint32_t src, uint32_t dst);
+extern uint32_t timer_add(uint64_t expire, RouterTimer timer);
+extern void timer_cancel(uint32_t id);
+extern uint64_t timer_now();
+extern const NextHopGroup *nhg_get(uint32_t id);
+
+// IP 头 + UDP 头 + RIP 头 + 25 项
+#define RIP_PACKET_MAX (20 + 8 + 4 + RIP_MAX_ENTRY * 20)
+
+#ifndef ADVERT_SUMMARIZE
+#define ADVERT_SUMMARIZE 0
+#endif
+
+struct AdvertView {
+  vector<RipEntry> entries;
+  PrefixHash<uint32_t> position; // (addr, len) -> entries 中的下标
+  vector<uint8_t> wire; // 每组 RIP_PACKET_MAX 字节
+  vector<uint32_t> wire_len; // 每组包的长度，0 表示需要重新组装
+  uint32_t src, dst; // 缓存的包使用的源、目的地址
+  vector<RipEntry> changed; // 等待触发更新的表项
+  PrefixHash<uint32_t> changed_position; // (addr, len) -> changed 中的下标
+  PrefixHash<uint32_t> excluded; // 出端口就是这个端口的前缀，水平分割不通告或毒性逆转
+  vector<RipEntry> summary; // 汇总后实际通告的表项，按前缀排序
+  bool summary_dirty;
+};
+
+AdvertView views[N_IFACE_ON_BOARD];
+PrefixHash<uint32_t> gc_timers; // 正在以 metric 16 通告的前缀 -> 垃圾回收定时器编号
+bool summarize = ADVERT_SUMMARIZE;
+bool poison_reverse = true;
+
+static void mark_dirty(AdvertView &view, uint32_t pos) {
+  if (summarize) {
+    // 汇总结果中的位置与 entries 无关，重新计算时再比较
+    view.summary_dirty = true;
+    return;
+  }
+  uint32_t chunk = pos / RIP_MAX_ENTRY;
+  if (chunk < view.wire_len.size()) {
+    view.wire_len[chunk] = 0;
+  }
+}
+
+static void record_change(AdvertView &view, uint32_t len, const RipEntry &entry) {
+  uint32_t *pos = view.changed_position.find(entry.addr, len);
+  if (pos != NULL) {
+    view.changed[*pos] = entry;
+  } else {
+    view.changed_position.insert(entry.addr, len, view.changed.size());
+    view.changed.push_back(entry);
+  }
+}
+
+static void forget_change(AdvertView &view, uint32_t addr, uint32_t len) {
+  uint32_t *pos = view.changed_position.find(addr, len);
+  if (pos == NULL) {
+    return;
+  }
+  uint32_t i = *pos;
+  view.changed_position.erase(addr, len);
+  RipEntry &last = view.changed.back();
+  if (i + 1 != view.changed.size()) {
+    view.changed[i] = last;
+    *view.changed_position.find(last.addr, __builtin_popcount(last.mask)) = i;
+  }
+  view.changed.pop_back();
+}
+
+static void view_remove(AdvertView &view, uint32_t addr, uint32_t len) {
+  uint32_t *pos = view.position.find(addr, len);
+  if (pos == NULL) {
+    return;
+  }
+  // 用最后一项填补空位
+  uint32_t i = *pos;
+  view.position.erase(addr, len);
+  mark_dirty(view, i);
+  mark_dirty(view, view.entries.size() - 1);
+  RipEntry &last = view.entries.back();
+  if (i + 1 != view.entries.size()) {
+    view.entries[i] = last;
+    *view.position.find(last.addr, __builtin_popcount(last.mask)) = i;
+  }
+  view.entries.pop_back();
+}
+
+enum SummaryKind {
+  SUMMARY_ROUTE, // 可达的路由，可以合并、被覆盖
+  SUMMARY_WITHDRAWN, // metric 16 ，照常通告
+  SUMMARY_EXCLUDED // 出端口就是这个端口，不参与合并
+};
+
+struct SummaryItem {
+  uint32_t addr, len, nexthop, metric;
+  SummaryKind kind;
+  bool alive; // 合并后为 false
+};
+
+// 按地址（主机序）再按长度排序，上级前缀排在它覆盖的前缀之前
+static bool prefix_less(uint32_t addr_a, uint32_t len_a, uint32_t addr_b, uint32_t len_b) {
+  uint32_t a = __builtin_bswap32(addr_a);
+  uint32_t b = __builtin_bswap32(addr_b);
+  return a != b ? a < b : len_a < len_b;
+}
+
+static bool entry_less(const RipEntry &a, const RipEntry &b) {
+  return prefix_less(a.addr, __builtin_popcount(a.mask), b.addr, __builtin_popcount(b.mask));
+}
+
+static void summarize_view(AdvertView &view, vector<RipEntry> *res) {
+  vector<SummaryItem> items;
+  PrefixHash<uint32_t> index; // 可达路由的 (addr, len) -> items 中的下标
+  vector<uint32_t> by_len[33];
+  for (uint32_t i = 0; i < view.entries.size(); i++) {
+    const RipEntry &e = view.entries[i];
+    uint32_t len = __builtin_popcount(e.mask);
+    SummaryItem item = {e.addr, len, e.nexthop, e.metric, e.metric < 16 ? SUMMARY_ROUTE : SUMMARY_WITHDRAWN, true};
+    if (item.kind == SUMMARY_ROUTE) {
+      index.insert(e.addr, len, items.size());
+      by_len[len].push_back(items.size());
+    }
+    items.push_back(item);
+  }
+
+  // 从长到短合并兄弟前缀，合并出的父前缀再参与上一层的合并
+  for (uint32_t len = 32; len > 0; len--) {
+    uint32_t bit = len_to_mask(len) ^ len_to_mask(len - 1);
+    for (uint32_t k = 0; k < by_len[len].size(); k++) {
+      SummaryItem item = items[by_len[len][k]];
+      if (!item.alive || (item.addr & bit) != 0) {
+        continue;
+      }
+      uint32_t *found = index.find(item.addr | bit, len);
+      if (found == NULL) {
+        continue;
+      }
+      uint32_t sibling = *found;
+      if (!items[sibling].alive || items[sibling].nexthop != item.nexthop || items[sibling].metric != item.metric ||
+          view.excluded.find(item.addr, len - 1) != NULL) {
+        continue;
+      }
+      items[by_len[len][k]].alive = false;
+      items[sibling].alive = false;
+      // 已有的父前缀完全被两个子前缀遮住，直接替换
+      uint32_t *parent = index.find(item.addr, len - 1);
+      if (parent != NULL) {
+        items[*parent].nexthop = item.nexthop;
+        items[*parent].metric = item.metric;
+      } else {
+        SummaryItem merged = {item.addr, len - 1, item.nexthop, item.metric, SUMMARY_ROUTE, true};
+        index.insert(item.addr, len - 1, items.size());
+        by_len[len - 1].push_back(items.size());
+        items.push_back(merged);
+      }
+    }
+  }
+
+  vector<SummaryItem> sorted;
+  for (uint32_t i = 0; i < items.size(); i++) {
+    if (!items[i].alive) {
+      continue;
+    }
+    // 合并出过同一前缀（之后可能又被合并到上一层），失效的路由已经被覆盖
+    if (items[i].kind == SUMMARY_WITHDRAWN && index.find(items[i].addr, items[i].len) != NULL) {
+      continue;
+    }
+    sorted.push_back(items[i]);
+  }
+  view.excluded.for_each([&](uint32_t addr, uint32_t len, uint32_t value) {
+    SummaryItem item = {addr, len, 0, 0, SUMMARY_EXCLUDED, true};
+    sorted.push_back(item);
+  });
+  std::sort(sorted.begin(), sorted.end(), [](const SummaryItem &a, const SummaryItem &b) {
+    return prefix_less(a.addr, a.len, b.addr, b.len);
+  });
+
+  // 按前缀顺序遍历，栈中是当前前缀的所有保留下来的上级前缀
+  vector<SummaryItem> stack;
+  res->clear();
+  for (uint32_t i = 0; i < sorted.size(); i++) {
+    const SummaryItem &item = sorted[i];
+    while (!stack.empty() && (item.addr & len_to_mask(stack.back().len)) != stack.back().addr) {
+      stack.pop_back();
+    }
+    if (item.kind == SUMMARY_ROUTE && !stack.empty() && stack.back().kind == SUMMARY_ROUTE &&
+        stack.back().nexthop == item.nexthop && stack.back().metric == item.metric) {
+      continue;
+    }
+    stack.push_back(item);
+    if (item.kind != SUMMARY_EXCLUDED) {
+      RipEntry entry = {
+        .addr = item.addr,
+        .mask = len_to_mask(item.len),
+        .nexthop = item.nexthop,
+        .metric = item.metric
+      };
+      res->push_back(entry);
+    }
+  }
+}
+
+static void record_change(AdvertView &view, uint32_t len, const RipEntry &entry);
+
+// 实际通告的表项，汇总时按需重新计算，并把与上一次结果的差别记为变化
+static const vector<RipEntry> &advertised(AdvertView &view) {
+  if (!summarize) {
+    return view.entries;
+  }
+  if (!view.summary_dirty) {
+    return view.summary;
+  }
+  vector<RipEntry> summary;
+  summarize_view(view, &summary);
+  const vector<RipEntry> &old = view.summary;
+  uint32_t i = 0, j = 0;
+  while (i < old.size() || j < summary.size()) {
+    if (j == summary.size() || (i < old.size() && entry_less(old[i], summary[j]))) {
+      if (old[i].metric != 16) {
+        RipEntry gone = old[i];
+        gone.metric = 16;
+        record_change(view, __builtin_popcount(gone.mask), gone);
+      }
+      i++;
+    } else if (i == old.size() || entry_less(summary[j], old[i])) {
+      record_change(view, __builtin_popcount(summary[j].mask), summary[j]);
+      j++;
+    } else {
+      if (old[i].nexthop != summary[j].nexthop || old[i].metric != summary[j].metric) {
+        record_change(view, __builtin_popcount(summary[j].mask), summary[j]);
+      }
+      i++;
+      j++;
+    }
+  }
+  // 只重新组装内容变化了的组
+  for (uint32_t c = 0; c < view.wire_len.size(); c++) {
+    uint32_t begin = c * RIP_MAX_ENTRY;
+    uint32_t end = begin + RIP_MAX_ENTRY;
+    if (end > summary.size() || end > old.size() ||
+        memcmp(&summary[begin], &old[begin], RIP_MAX_ENTRY * sizeof(RipEntry)) != 0) {
+      view.wire_len[c] = 0;
+    }
+  }
+  view.summary.swap(summary);
+  view.summary_dirty = false;
+  return view.summary;
+}
+
+// 表项是否从端口 if_index 出去，等价多路径的任何一条经过它都算
+static bool routes_via(const RoutingTableEntry &entry, uint32_t if_index) {
+  if (entry.group == 0) {
+    return entry.if_index == if_index;
+  }
+  const NextHopGroup *group = nhg_get(entry.group);
+  for (uint32_t k = 0; k < group->size; k++) {
+    if (group->if_index[k] == if_index) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief 路由表插入/替换/删除一条表项后，同步修改各端口要通告的表项
+ * @param insert 插入或替换为 true ，删除为 false
+ * @param entry 变化的表项
+ *
+ * 删除的路由以 metric 16 继续通告，ROUTE_GC 之后由 advert_gc 真正删除，ref. RFC2453 3.8 。
+ */
+void advert_update(bool insert, const RoutingTableEntry &entry) {
+  RipEntry rip_entry = {
+    .addr = entry.addr,
+    .mask = len_to_mask(entry.len),
+    .nexthop = entry.nexthop,
+    .metric = insert ? entry.metric : 16
+  };
+  uint32_t *gc = gc_timers.find(entry.addr, entry.len);
+  if (insert && gc != NULL) {
+    timer_cancel(*gc);
+    gc_timers.erase(entry.addr, entry.len);
+  }
+  bool unreachable = false;
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    AdvertView &view = views[i];
+    if (summarize) {
+      view.summary_dirty = true;
+    }
+    RipEntry adv = rip_entry;
+    if (insert && routes_via(entry, i)) {
+      view.excluded.insert(entry.addr, entry.len, 0);
+      if (!entry.learned || !poison_reverse) {
+        // 直连/静态路由按水平分割，这个端口上不再提起它
+        view_remove(view, entry.addr, entry.len);
+        if (!summarize) {
+          forget_change(view, entry.addr, entry.len);
+        }
+        continue;
+      }
+      // 从这个端口学到的路由毒性逆转，以 metric 16 通告回去，
+      // 邻居立即放弃经过这里的路径，不必等超时
+      adv.metric = 16;
+    } else {
+      view.excluded.erase(entry.addr, entry.len);
+    }
+    uint32_t *pos = view.position.find(entry.addr, entry.len);
+    if (!insert && pos == NULL) {
+      continue;
+    }
+    // 只有 FIB 中的下一跳组、备份路径变化时，通告的内容不变
+    if (pos != NULL && view.entries[*pos].nexthop == adv.nexthop && view.entries[*pos].metric == adv.metric) {
+      continue;
+    }
+    if (!summarize) {
+      record_change(view, entry.len, adv);
+    }
+    if (pos != NULL) {
+      view.entries[*pos] = adv;
+      mark_dirty(view, *pos);
+    } else {
+      mark_dirty(view, view.entries.size());
+      view.position.insert(entry.addr, entry.len, view.entries.size());
+      view.entries.push_back(adv);
+    }
+    unreachable = !insert;
+  }
+  if (unreachable && gc == NULL) {
+    RouterTimer timer = {
+      .kind = TIMER_ROUTE_GC,
+      .addr = entry.addr,
+      .len = entry.len
+    };
+    gc_timers.insert(entry.addr, entry.len, timer_add(timer_now() + ROUTE_GC, timer));
+  }
+}
+
+/**
+ * @brief 垃圾回收定时器到期，不再通告这条失效的路由
+ */
+void advert_gc(uint32_t addr, uint32_t len) {
+  gc_timers.erase(addr, len);
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    AdvertView &view = views[i];
+    uint32_t *pos = view.position.find(addr, len);
+    if (pos != NULL && view.entries[*pos].metric == 16) {
+      view_remove(view, addr, len);
+      if (!summarize) {
+        forget_change(view, addr, len);
+      }
+    }
+  }
+}
+
+/**
+ * @brief 清空某个端口等待触发更新的表项，向它发送触发更新或完整的定时更新后调用
+ */
+void advert_changes_clear(uint32_t if_index) {
+  // 汇总结果先算到最新，已经通告过的差别不再算作变化
+  advertised(views[if_index]);
+  views[if_index].changed.clear();
+  views[if_index].changed_position = PrefixHash<uint32_t>();
+}
+
+void advert_clear() {
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    views[i].entries.clear();
+    views[i].position = PrefixHash<uint32_t>();
+    views[i].wire_len.clear();
+    views[i].excluded = PrefixHash<uint32_t>();
+    views[i].summary.clear();
+    views[i].summary_dirty = true;
+    advert_changes_clear(i);
+  }
+  gc_timers.for_each([](uint32_t addr, uint32_t len, uint32_t id) {
+    timer_cancel(id);
+  });
+  gc_timers = PrefixHash<uint32_t>();
+}
+
+/**
+ * @brief 打开或关闭路由汇总，之后的定时更新按新的方式通告整张表
+ */
+void advert_set_summarize(bool enable) {
+  summarize = enable;
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    views[i].wire_len.clear();
+    views[i].summary.clear();
+    views[i].summary_dirty = true;
+    advert_changes_clear(i);
+  }
+}
+
+/**
+ * @brief 打开或关闭毒性逆转，关闭时学到的路由也只做水平分割，只应在添加路由之前调用
+ */
+void advert_set_poison_reverse(bool enable) {
+  poison_reverse = enable;
+}
+
+/**
+ * @brief 某个端口要通告的前缀个数
+ * @param count 写入实际通告的前缀个数，不汇总时与返回值相同
+ */
+uint32_t advert_prefixes(uint32_t if_index, uint32_t *count) {
+  *count = advertised(views[if_index]).size();
+  return views[if_index].entries.size();
+}
+
+/**
+ * @brief 向某个端口通告整张路由表需要的 RIP 包个数
+ */
+uint32_t advert_chunks(uint32_t if_index) {
+  return (advertised(views[if_index]).size() + RIP_MAX_ENTRY - 1) / RIP_MAX_ENTRY;
+}
+
+/**
+ * @brief 取出向某个端口通告的第 chunk 个 RIP Response
+ * @param packet 写入 command、numEntries 和表项
+ */
+void advert_packet(uint32_t if_index, uint32_t chunk, RipPacket *packet) {
+  const vector<RipEntry> &entries = advertised(views[if_index]);
+  uint32_t begin = chunk * RIP_MAX_ENTRY;
+  uint32_t n = entries.size() - begin < RIP_MAX_ENTRY ? entries.size() - begin : RIP_MAX_ENTRY;
+  packet->command = 2;
+  packet->numEntries = n;
+  memcpy(packet->entries, &entries[begin], n * sizeof(RipEntry));
+}
+
+/**
+ * @brief 取出向某个端口通告的第 chunk 个组装好的 IP 包，只在表项变化后重新组装
+ * @param src 源地址
+ * @param dst 目的地址，与上次不同时整个端口的缓存失效
+ * @param len 写入 IP 包的长度
+ * @return 指向缓存的包，在下一次修改路由表或调用本函数之前有效
+ */
+const uint8_t *advert_wire(uint32_t if_index, uint32_t chunk, uint32_t src, uint32_t dst, uint32_t *len) {
+  AdvertView &view = views[if_index];
+  uint32_t chunks = advert_chunks(if_index);
+  if (view.src != src || view.dst != dst) {
+    view.src = src;
+    view.dst = dst;
+    view.wire_len.clear();
+  }
+  if (view.wire_len.size() != chunks) {
+    view.wire_len.resize(chunks, 0);
+    view.wire.resize(chunks * RIP_PACKET_MAX);
+  }
+  uint8_t *buffer = &view.wire[chunk * RIP_PACKET_MAX];
+  if (view.wire_len[chunk] == 0) {
+    RipPacket rip;
+    advert_packet(if_index, chunk, &rip);
+    uint32_t riplen = assemble(&rip, buffer);
+    uint32_t udplen = assembleUDP(buffer, riplen);
+    view.wire_len[chunk] = assembleIP(buffer, udplen, src, dst);
+  }
+  *len = view.wire_len[chunk];
+  return buffer;
+}
+
+/**
+ * @brief 触发更新需要向某个端口发送的 RIP 包个数
+ */
+uint32_t advert_changed_chunks(uint32_t if_index) {
+  advertised(views[if_index]);
+  return (views[if_index].changed.size() + RIP_MAX_ENTRY - 1) / RIP_MAX_ENTRY;
+}
+
+/**
+ * @brief 取出向某个端口发送的第 chunk 个触发更新
+ * @param packet 写入 command、numEntries 和变化过的表项
+ */
+void advert_changed_packet(uint32_t if_index, uint32_t chunk, RipPacket *packet) {
+  const vector<RipEntry> &entries = views[if_index].changed;
+  uint32_t begin = chunk * RIP_MAX_ENTRY;
+  uint32_t n = entries.size() - begin < RIP_MAX_ENTRY ? entries.size() - begin : RIP_MAX_ENTRY;
+  packet->command = 2;
+  packet->numEntries = n;
+  memcpy(packet->entries, &entries[begin], n * sizeof(RipEntry));
+}
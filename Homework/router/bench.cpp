@@ -0,0 +1,1061 @@
+#include "rib.h"
+#include "rip.h"
+#include "router.h"
+#include "router_hal.h"
+#include "routing_table.h"
+#include "timer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+  路由器各部分的性能测试，不需要 HAL，用法：
+    ./bench <case> [route file]
+  route file 默认为 ../../Setup/conf-part9.conf 。
+*/
+
+extern void build(RoutingTableEntry *entries, uint32_t n);
+extern bool rib_update(uint32_t addr, uint32_t len, RibCandidate cand, vector<FibDelta> *deltas);
+extern void rib_best_routes(vector<RoutingTableEntry> *res);
+extern int load_static_routes(const char *path, const uint32_t *if_addrs, uint32_t default_if, vector<RoutingTableEntry> *res);
+extern uint32_t flow_hash(const uint8_t *packet, size_t len);
+extern bool validateIPChecksum(uint8_t *packet, size_t len);
+extern bool forward(uint8_t *packet, size_t len);
+extern bool forward_fast(uint8_t *packet, size_t len);
+extern bool query_flow(uint32_t addr, uint32_t hash, uint32_t *nexthop, uint32_t *if_index);
+extern bool parse_rip(const uint8_t *packet, uint32_t len, RipView *view);
+extern bool parse_rip_header(const uint8_t *packet, uint32_t len, RipView *view);
+extern bool rip_entries_valid(const RipView &view);
+extern bool disassemble(const uint8_t *packet, uint32_t len, RipPacket *output);
+extern uint32_t assemble(const RipPacket *rip, uint8_t *buffer);
+extern uint32_t assembleUDP(uint8_t *buffer, uint32_t riplen);
+extern uint32_t assembleIP(uint8_t *buffer, uint32_t udplen, uint32_t src, uint32_t dst);
+extern void fib_apply(const vector<FibDelta> &deltas);
+extern void fib_stage(const vector<FibDelta> &deltas);
+extern uint32_t fib_commit();
+extern uint64_t fp_compute(uint32_t src_addr, uint32_t if_index, const RipView &rip);
+extern uint32_t fp_lookup(uint64_t fingerprint);
+extern void fp_refresh(uint32_t id, uint64_t time);
+extern uint32_t fp_create(uint64_t fingerprint, uint32_t src_addr, uint32_t if_index, uint64_t time);
+extern void fp_commit(uint32_t id, uint32_t expected, bool withdrawals);
+extern void advert_set_summarize(bool enable);
+extern void update(bool insert, RoutingTableEntry entry);
+extern uint32_t fib_prefixes();
+extern bool fib_verify();
+extern RoutingTable<PatriciaEngine<RoutingTableEntry> > table;
+extern RoutingTable<ROUTING_ENGINE<RoutingTableEntry> > fib;
+extern uint32_t advert_prefixes(uint32_t if_index, uint32_t *count);
+extern uint32_t advert_chunks(uint32_t if_index);
+extern const uint8_t *advert_wire(uint32_t if_index, uint32_t chunk, uint32_t src, uint32_t dst, uint32_t *len);
+extern uint32_t advert_changed_chunks(uint32_t if_index);
+extern void advert_changed_packet(uint32_t if_index, uint32_t chunk, RipPacket *packet);
+extern void advert_changes_clear(uint32_t if_index);
+extern void advert_set_poison_reverse(bool enable);
+extern void advert_gc(uint32_t addr, uint32_t len);
+extern bool rib_withdraw(uint32_t addr, uint32_t len, uint32_t nexthop, uint32_t if_index, vector<FibDelta> *deltas);
+extern bool rib_expire(uint32_t addr, uint32_t len, uint32_t nexthop, uint32_t if_index, uint64_t now, vector<FibDelta> *deltas);
+extern void rib_holddown_end(uint32_t addr, uint32_t len);
+extern bool query(uint32_t addr, uint32_t *nexthop, uint32_t *if_index, uint32_t *metric);
+extern void timer_start(uint64_t now);
+extern uint64_t timer_now();
+extern uint32_t timer_add(uint64_t expire, RouterTimer timer);
+extern void timer_modify(uint32_t id, uint64_t expire);
+extern void timer_advance(uint64_t now, void (*handler)(const RouterTimer &timer));
+extern uint64_t timer_next(uint64_t limit);
+extern uint32_t rib_withdraw_neighbor(uint32_t nexthop, uint32_t if_index, vector<FibDelta> *deltas);
+extern void adjacency_set_down(uint32_t nexthop, uint32_t if_index, bool down);
+extern void adjacency_set_port_down(uint32_t if_index, bool down);
+
+// main.cpp is not linked into the benchmark
+std::string ip_string(uint32_t addr) {
+  char buffer[20];
+  sprintf(buffer, "%d.%d.%d.%d", addr & 0x000000FF, (addr >> 8) & 0x000000FF, (addr >> 16) & 0x000000FF, (addr >> 24) & 0x000000FF);
+  return std::string(buffer);
+}
+
+uint32_t addrs[N_IFACE_ON_BOARD] = {0x0103A8C0, 0x0101A8C0, 0x0102000a, 0x0103000a};
+
+static double now_ms() {
+  struct timespec tp;
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+  return tp.tv_sec * 1000.0 + tp.tv_nsec / 1000000.0;
+}
+
+static uint32_t random_u32() {
+  return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+static vector<RoutingTableEntry> load_routes(const char *path) {
+  vector<RoutingTableEntry> routes;
+  if (load_static_routes(path, addrs, 0, &routes) < 0) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    exit(1);
+  }
+  return routes;
+}
+
+// 目的地址落在表中随机一个前缀内的 UDP 报文，源地址和端口随机
+static void make_packets(const vector<RoutingTableEntry> &routes, uint32_t n, vector<uint8_t> *packets) {
+  packets->assign(n * 28, 0);
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t *p = &(*packets)[i * 28];
+    const RoutingTableEntry &r = routes[random_u32() % routes.size()];
+    uint32_t src = random_u32();
+    uint32_t dst = r.addr | (random_u32() & ~len_to_mask(r.len));
+    p[0] = 0x45;
+    p[8] = 64;
+    p[9] = 17;
+    memcpy(&p[12], &src, sizeof(uint32_t));
+    memcpy(&p[16], &dst, sizeof(uint32_t));
+    uint32_t ports = random_u32();
+    memcpy(&p[20], &ports, sizeof(uint32_t));
+  }
+}
+
+static double run_lookups(const vector<uint8_t> &packets, uint32_t n, uint32_t *per_if) {
+  double begin = now_ms();
+  for (uint32_t i = 0; i < n; i++) {
+    const uint8_t *p = &packets[i * 28];
+    uint32_t dst, nexthop, if_index;
+    memcpy(&dst, &p[16], sizeof(uint32_t));
+    if (query_flow(dst, flow_hash(p, 28), &nexthop, &if_index)) {
+      per_if[if_index]++;
+    }
+  }
+  return now_ms() - begin;
+}
+
+// 单路径与 4 路等价多路径的转发查询开销，以及各端口的负载分布
+static void bench_ecmp(const char *path) {
+  vector<RoutingTableEntry> routes = load_routes(path);
+  const uint32_t n = 100000;
+  vector<uint8_t> packets;
+  make_packets(routes, n, &packets);
+
+  vector<FibDelta> deltas;
+  for (uint32_t i = 0; i < routes.size(); i++) {
+    RibCandidate cand = {addrs[0] + 0x02000000, 0, 2, 0};
+    rib_update(routes[i].addr, routes[i].len, cand, &deltas);
+  }
+  vector<RoutingTableEntry> fib;
+  rib_best_routes(&fib);
+  build(fib.data(), fib.size());
+  uint32_t single[N_IFACE_ON_BOARD] = {0};
+  double single_ms = run_lookups(packets, n, single);
+
+  for (uint32_t i = 0; i < routes.size(); i++) {
+    for (uint32_t j = 1; j < N_IFACE_ON_BOARD; j++) {
+      RibCandidate cand = {addrs[j] + 0x02000000, j, 2, 0};
+      rib_update(routes[i].addr, routes[i].len, cand, &deltas);
+    }
+  }
+  fib.clear();
+  rib_best_routes(&fib);
+  build(fib.data(), fib.size());
+  uint32_t ecmp[N_IFACE_ON_BOARD] = {0};
+  double ecmp_ms = run_lookups(packets, n, ecmp);
+
+  // 端口 1 失效，RIB 撤销路由之前它的流由其余成员分担
+  adjacency_set_port_down(1, true);
+  uint32_t down[N_IFACE_ON_BOARD] = {0};
+  double down_ms = run_lookups(packets, n, down);
+  adjacency_set_port_down(1, false);
+
+  printf("%zu routes, %u lookups\n", fib.size(), n);
+  printf("single path: %.1f ms, %.1f ns/lookup\n", single_ms, single_ms * 1e6 / n);
+  printf("ecmp x%d:     %.1f ms, %.1f ns/lookup\n", N_IFACE_ON_BOARD, ecmp_ms, ecmp_ms * 1e6 / n);
+  printf("if 1 down:   %.1f ms, %.1f ns/lookup\n", down_ms, down_ms * 1e6 / n);
+  for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
+    printf("  if %d: single %u, ecmp %u, if 1 down %u\n", i, single[i], ecmp[i], down[i]);
+  }
+}
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+// 编译时选择的查询结构的建表、逐个查询和批量查询的开销，make bench ENGINE=... 切换
+static void bench_lookup(const char *path) {
+  vector<RoutingTableEntry> routes = load_routes(path);
+  const uint32_t n = 1000000;
+  vector<uint32_t> dsts(n);
+  for (uint32_t i = 0; i < n; i++) {
+    const RoutingTableEntry &r = routes[random_u32() % routes.size()];
+    dsts[i] = r.addr | (random_u32() & ~len_to_mask(r.len));
+  }
+
+  static RoutingTable<ROUTING_ENGINE<RoutingTableEntry> > table;
+  double begin = now_ms();
+  table.build(routes.data(), routes.size());
+  double build_ms = now_ms() - begin;
+
+  uint32_t found = 0;
+  begin = now_ms();
+  for (uint32_t i = 0; i < n; i++) {
+    found += table.query(dsts[i]) != NULL;
+  }
+  double query_ms = now_ms() - begin;
+
+  const RoutingTableEntry *res[16];
+  begin = now_ms();
+  for (uint32_t i = 0; i + 16 <= n; i += 16) {
+    table.query_batch(&dsts[i], 16, res);
+    for (uint32_t j = 0; j < 16; j++) {
+      found += res[j] != NULL;
+    }
+  }
+  double batch_ms = now_ms() - begin;
+
+  printf("%s: %u routes, build %.2f ms\n", STRINGIFY(ROUTING_ENGINE), table.size(), build_ms);
+  printf("query:       %.1f ns/lookup\n", query_ms * 1e6 / n);
+  printf("query_batch: %.1f ns/lookup\n", batch_ms * 1e6 / n);
+  printf("(%u found)\n", found);
+}
+
+template <class Table>
+static double run_churn(Table *table, vector<RoutingTableEntry> &routes, uint32_t n) {
+  table->build(routes.data(), routes.size());
+  srand(2);
+  double begin = now_ms();
+  for (uint32_t i = 0; i < n; i++) {
+    RoutingTableEntry &r = routes[random_u32() % routes.size()];
+    table->erase(r.addr, r.len);
+    r.nexthop++;
+    table->insert(r);
+  }
+  return now_ms() - begin;
+}
+
+// 反复删除再插入路由，对比节点池与直接 new/delete 的开销和内存占用
+static void bench_churn(const char *path) {
+  vector<RoutingTableEntry> routes = load_routes(path);
+  const uint32_t n = 50000;
+  static RoutingTable<ROUTING_ENGINE<RoutingTableEntry> > pooled;
+  static RoutingTable<ROUTING_ENGINE<RoutingTableEntry, HeapPool> > heap;
+  double pool_ms = run_churn(&pooled, routes, n);
+  double heap_ms = run_churn(&heap, routes, n);
+
+  printf("%s: %u routes, %u erase+insert\n", STRINGIFY(ROUTING_ENGINE), pooled.size(), n);
+  printf("node pool:  %.1f ns/op, %zu bytes allocated, %zu used\n", pool_ms * 1e6 / n, pooled.allocated_bytes(), pooled.used_bytes());
+  printf("new/delete: %.1f ns/op, %zu bytes used\n", heap_ms * 1e6 / n, heap.used_bytes());
+}
+
+// 解析满 25 项的 RIP Response：只校验不拷贝的 parse_rip 与拷贝到 RipPacket 的 disassemble
+static void bench_parse(const char *path) {
+  vector<RoutingTableEntry> routes = load_routes(path);
+  const uint32_t n = routes.size() / RIP_MAX_ENTRY;
+  vector<uint8_t> packets(n * 2048);
+  vector<uint32_t> lens(n);
+  for (uint32_t i = 0; i < n; i++) {
+    RipPacket rip;
+    rip.command = 2;
+    rip.numEntries = RIP_MAX_ENTRY;
+    for (uint32_t j = 0; j < RIP_MAX_ENTRY; j++) {
+      const RoutingTableEntry &r = routes[i * RIP_MAX_ENTRY + j];
+      RipEntry entry = {r.addr, len_to_mask(r.len), r.nexthop, r.metric};
+      rip.entries[j] = entry;
+    }
+    uint8_t *p = &packets[i * 2048];
+    lens[i] = assembleIP(p, assembleUDP(p, assemble(&rip, p)), addrs[0], 0x090000e0);
+  }
+  const uint32_t rounds = 2000;
+  uint32_t entries = 0;
+  double begin = now_ms();
+  for (uint32_t k = 0; k < rounds; k++) {
+    for (uint32_t i = 0; i < n; i++) {
+      RipView view;
+      if (parse_rip(&packets[i * 2048], lens[i], &view)) {
+        entries += view.numEntries;
+      }
+    }
+  }
+  double parse_ms = now_ms() - begin;
+  begin = now_ms();
+  for (uint32_t k = 0; k < rounds; k++) {
+    for (uint32_t i = 0; i < n; i++) {
+      RipPacket rip;
+      if (disassemble(&packets[i * 2048], lens[i], &rip)) {
+        entries += rip.numEntries;
+      }
+    }
+  }
+  double copy_ms = now_ms() - begin;
+
+  printf("%u packets x %u rounds, %u entries\n", n, rounds, entries);
+  printf("parse_rip:   %.1f ns/packet\n", parse_ms * 1e6 / n / rounds);
+  printf("disassemble: %.1f ns/packet\n", copy_ms * 1e6 / n / rounds);
+}
+
+// 邻居通告的一整张表，每个包 25 项，metric 都相同
+static void make_burst(const vector<RoutingTableEntry> &routes, uint32_t metric, vector<uint8_t> *wire, vector<uint32_t> *lens) {
+  uint32_t n = (routes.size() + RIP_MAX_ENTRY - 1) / RIP_MAX_ENTRY;
+  wire->assign(n * 2048, 0);
+  lens->resize(n);
+  for (uint32_t i = 0; i < n; i++) {
+    RipPacket rip;
+    rip.command = 2;
+    rip.numEntries = 0;
+    for (uint32_t j = i * RIP_MAX_ENTRY; j < routes.size() && j < (i + 1) * RIP_MAX_ENTRY; j++) {
+      RipEntry entry = {routes[j].addr, len_to_mask(routes[j].len), 0, metric};
+      rip.entries[rip.numEntries++] = entry;
+    }
+    uint8_t *p = &(*wire)[i * 2048];
+    (*lens)[i] = assembleIP(p, assembleUDP(p, assemble(&rip, p)), 0x0202000a, 0x090000e0);
+  }
+}
+
+enum IngestMode {
+  INGEST_ENTRY, // 每个表项单独写入路由表
+  INGEST_PACKET, // 每个包写入一次
+  INGEST_BATCH // 整个窗口写入一次
+};
+
+// 按 mode 处理一次邻居的通告，返回写入路由表的增量个数
+static uint32_t ingest(const vector<uint8_t> &wire, const vector<uint32_t> &lens, IngestMode mode, uint64_t time) {
+  uint32_t applied = 0;
+  vector<FibDelta> deltas;
+  for (uint32_t i = 0; i < lens.size(); i++) {
+    RipView rip;
+    if (!parse_rip(&wire[i * 2048], lens[i], &rip)) {
+      continue;
+    }
+    for (uint32_t j = 0; j < rip.numEntries; j++) {
+      RibCandidate cand = {0x0202000a, 2, rip.entries[j].metric_value() + 1, time};
+      rib_update(rip.entries[j].addr & rip.entries[j].mask, __builtin_popcount(rip.entries[j].mask), cand, &deltas);
+      if (mode == INGEST_ENTRY) {
+        applied += deltas.size();
+        fib_apply(deltas);
+        deltas.clear();
+      }
+    }
+    if (mode == INGEST_PACKET) {
+      applied += deltas.size();
+      fib_apply(deltas);
+    } else if (mode == INGEST_BATCH) {
+      fib_stage(deltas);
+    }
+    deltas.clear();
+  }
+  return applied;
+}
+
+// n 条随机的 /16 到 /24 路由，排序去重
+static void random_routes(uint32_t n, vector<RoutingTableEntry> *routes) {
+  while (routes->size() < n) {
+    RoutingTableEntry r = {};
+    r.len = 16 + random_u32() % 9;
+    r.addr = random_u32() & len_to_mask(r.len);
+    routes->push_back(r);
+  }
+  std::sort(routes->begin(), routes->end(), [](const RoutingTableEntry &a, const RoutingTableEntry &b) {
+    return a.addr != b.addr ? a.addr < b.addr : a.len < b.len;
+  });
+  routes->erase(std::unique(routes->begin(), routes->end(), [](const RoutingTableEntry &a, const RoutingTableEntry &b) {
+    return a.addr == b.addr && a.len == b.len;
+  }), routes->end());
+}
+
+// 一个通告 10000 条路由的邻居在一个批量窗口内连续发来两次整张表（metric 变化了一次），
+// 对比逐项、逐包和整批写入路由表的吞吐
+static void bench_ingest(const char *path) {
+  vector<RoutingTableEntry> routes;
+  random_routes(10000, &routes);
+
+  vector<uint8_t> wire[7];
+  vector<uint32_t> lens[7];
+  for (uint32_t m = 0; m < 7; m++) {
+    make_burst(routes, m + 1, &wire[m], &lens[m]);
+  }
+  ingest(wire[0], lens[0], INGEST_PACKET, 1);
+
+  const char *names[] = {"per entry", "per packet", "batched"};
+  for (uint32_t mode = INGEST_ENTRY; mode <= INGEST_BATCH; mode++) {
+    double begin = now_ms();
+    uint32_t applied = ingest(wire[mode * 2 + 1], lens[mode * 2 + 1], (IngestMode)mode, 2 + mode);
+    applied += ingest(wire[mode * 2 + 2], lens[mode * 2 + 2], (IngestMode)mode, 2 + mode);
+    if (mode == INGEST_BATCH) {
+      applied += fib_commit();
+    }
+    double ms = now_ms() - begin;
+    printf("%-10s: %zu routes x 2 in %.2f ms, %.0f routes/s, %u FIB updates\n", names[mode], routes.size(), ms, routes.size() * 2 / ms * 1000, applied);
+  }
+}
+
+// 与 main.cpp 相同的处理：和之前完全相同的包只刷新 chunk ，返回走了快速路径的包数
+static uint32_t ingest_fingerprint(const vector<uint8_t> &wire, const vector<uint32_t> &lens, uint64_t time) {
+  uint32_t refreshed = 0;
+  vector<FibDelta> deltas;
+  for (uint32_t i = 0; i < lens.size(); i++) {
+    RipView rip;
+    if (!parse_rip_header(&wire[i * 2048], lens[i], &rip)) {
+      continue;
+    }
+    uint64_t fingerprint = fp_compute(0x0202000a, 2, rip);
+    uint32_t chunk = fp_lookup(fingerprint);
+    if (chunk == 0 && !rip_entries_valid(rip)) {
+      continue;
+    }
+    if (chunk != 0) {
+      fp_refresh(chunk, time);
+      refreshed++;
+      continue;
+    }
+    chunk = fp_create(fingerprint, 0x0202000a, 2, time);
+    for (uint32_t j = 0; j < rip.numEntries; j++) {
+      RibCandidate cand = {0x0202000a, 2, rip.entries[j].metric_value() + 1, time, 0, chunk};
+      rib_update(rip.entries[j].addr & rip.entries[j].mask, __builtin_popcount(rip.entries[j].mask), cand, &deltas);
+    }
+    fp_commit(chunk, rip.numEntries, false);
+    fib_stage(deltas);
+    deltas.clear();
+  }
+  fib_commit();
+  return refreshed;
+}
+
+// 稳定状态下一个通告 10000 条路由的邻居每个周期重发同样的整张表，
+// 对比逐项处理与按指纹只刷新的耗时
+static void bench_refresh(const char *path) {
+  vector<RoutingTableEntry> routes;
+  random_routes(10000, &routes);
+  vector<uint8_t> wire;
+  vector<uint32_t> lens;
+  make_burst(routes, 1, &wire, &lens);
+  const uint32_t rounds = 50;
+
+  ingest(wire, lens, INGEST_BATCH, 1);
+  fib_commit();
+  double begin = now_ms();
+  for (uint32_t r = 0; r < rounds; r++) {
+    ingest(wire, lens, INGEST_BATCH, 2 + r);
+    fib_commit();
+  }
+  double full_ms = (now_ms() - begin) / rounds;
+
+  ingest_fingerprint(wire, lens, 2 + rounds);
+  uint32_t refreshed = 0;
+  begin = now_ms();
+  for (uint32_t r = 0; r < rounds; r++) {
+    refreshed += ingest_fingerprint(wire, lens, 3 + rounds + r);
+  }
+  double fp_ms = (now_ms() - begin) / rounds;
+  printf("%zu routes in %zu packets per cycle\n", routes.size(), lens.size());
+  printf("per entry:   %.3f ms/cycle\n", full_ms);
+  printf("fingerprint: %.3f ms/cycle, %u/%zu packets refreshed only, %.1fx\n", fp_ms, refreshed, lens.size() * rounds, full_ms / fp_ms);
+}
+
+// 路由文件中的路由都从端口 0 出去，其余端口通告它们时汇总前后的前缀数和包数
+static void bench_summary(const char *path) {
+  vector<RoutingTableEntry> routes = load_routes(path);
+  build(routes.data(), routes.size());
+  uint32_t prefixes[N_IFACE_ON_BOARD], chunks[N_IFACE_ON_BOARD];
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    uint32_t count;
+    prefixes[i] = advert_prefixes(i, &count);
+    chunks[i] = advert_chunks(i);
+  }
+  double begin = now_ms();
+  advert_set_summarize(true);
+  double ms = now_ms() - begin;
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    uint32_t count;
+    advert_prefixes(i, &count);
+    printf("port %u: %u -> %u prefixes (-%.1f%%), %u -> %u packets\n", i, prefixes[i], count,
+           prefixes[i] == 0 ? 0.0 : 100.0 * (prefixes[i] - count) / prefixes[i], chunks[i], advert_chunks(i));
+  }
+  printf("summarized %u ports in %.2f ms\n", N_IFACE_ON_BOARD, ms);
+}
+
+static void report_compress(const char *name) {
+  printf("%-9s: %u routes -> %u FIB prefixes, FIB uses %.1f KB besides tbl24, verify %s\n", name, table.size(), fib_prefixes(),
+         (fib.used_bytes() - (1 << 24) * sizeof(uint32_t)) / 1024.0, fib_verify() ? "ok" : "FAILED");
+}
+
+// 转发表压缩：路由文件原样（都从端口 0 出去）和随机分到 4 个端口时的前缀数，
+// 以及随机增删路由时增量压缩的开销，每一步都与完整路由表做差分检查
+static void bench_compress(const char *path) {
+  vector<RoutingTableEntry> routes = load_routes(path);
+  build(routes.data(), routes.size());
+  report_compress("one port");
+
+  for (uint32_t i = 0; i < routes.size(); i++) {
+    routes[i].if_index = random_u32() % N_IFACE_ON_BOARD;
+    routes[i].nexthop = addrs[routes[i].if_index] + 0x02000000;
+  }
+  build(routes.data(), routes.size());
+  report_compress("4 ports");
+
+  const uint32_t n = 20000;
+  bool ok = true;
+  double begin = now_ms();
+  for (uint32_t i = 0; i < n; i++) {
+    RoutingTableEntry r = routes[random_u32() % routes.size()];
+    uint32_t op = random_u32() % 3;
+    if (op == 0) {
+      update(false, r);
+    } else {
+      if (op == 1) {
+        r.len = 8 + random_u32() % 21;
+        r.addr = random_u32() & len_to_mask(r.len);
+      }
+      r.if_index = random_u32() % N_IFACE_ON_BOARD;
+      r.nexthop = addrs[r.if_index] + 0x02000000;
+      update(true, r);
+    }
+    if (i % 2000 == 1999) {
+      ok = ok && fib_verify();
+    }
+  }
+  double ms = now_ms() - begin;
+  printf("churn    : %u updates in %.1f ms, %.2f us/update, verify %s\n", n, ms, ms * 1000 / n, ok ? "ok" : "FAILED");
+  report_compress("after");
+}
+
+// 邻居 A（端口 0）通告全部路由，邻居 B（端口 1）通告其中一半、metric 大 1 ，是无环备份路径。
+// A 失效时对比转发面切换到备份路径（置一个标志）和 RIB 删除 A 的路由再写入 FIB 的耗时，
+// 以及两种情况下转发查询的开销
+// 转发时 IP 头的处理：校验、复制再由 forward 重新求和更新，与一遍完成的 forward_fast 比较，
+// 并逐字节检查两者的结果相同；每 16 个报文有一个带 4 字节选项，走 forward_fast 的慢速路径
+static void bench_forward(const char *path) {
+  const uint32_t n = 1000000, size = 64;
+  vector<uint8_t> packets(n * size, 0);
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t *p = &packets[i * size];
+    uint32_t ihl = i % 16 == 0 ? 24 : 20;
+    p[0] = 0x40 | (ihl >> 2);
+    p[3] = size;
+    p[8] = 2 + random_u32() % 254;
+    p[9] = 17;
+    uint32_t src = random_u32(), dst = random_u32();
+    memcpy(&p[12], &src, sizeof(uint32_t));
+    memcpy(&p[16], &dst, sizeof(uint32_t));
+    memset(&p[20], 1, ihl - 20); // NOP
+    uint32_t sum = 0;
+    for (uint32_t j = 0; j < ihl; j += 2) {
+      sum += (p[j] << 8) | p[j + 1];
+    }
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = ~sum & 0xFFFF;
+    p[10] = sum >> 8;
+    p[11] = sum & 0xFF;
+  }
+  vector<uint8_t> fused(packets);
+  static uint8_t output[2048];
+
+  uint32_t sent = 0;
+  double begin = now_ms();
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t *p = &packets[i * size];
+    if (validateIPChecksum(p, size)) {
+      memcpy(output, p, size);
+      sent += forward(output, size);
+    }
+  }
+  double separate_ms = now_ms() - begin;
+
+  uint32_t fused_sent = 0;
+  begin = now_ms();
+  for (uint32_t i = 0; i < n; i++) {
+    fused_sent += forward_fast(&fused[i * size], size);
+  }
+  double fused_ms = now_ms() - begin;
+
+  uint32_t mismatch = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    memcpy(output, &packets[i * size], size);
+    forward(output, size);
+    mismatch += memcmp(output, &fused[i * size], size) != 0;
+  }
+  printf("validate + copy + forward: %.1f ns/packet (%u sent)\n", separate_ms * 1e6 / n, sent);
+  printf("forward_fast:              %.1f ns/packet (%u sent)\n", fused_ms * 1e6 / n, fused_sent);
+  printf("%u results differ\n", mismatch);
+}
+
+static void bench_failover(const char *path) {
+  vector<RoutingTableEntry> routes;
+  random_routes(10000, &routes);
+  const uint32_t a = 0x0200000a, b = 0x0201000a;
+  vector<FibDelta> deltas;
+  for (uint32_t i = 0; i < routes.size(); i++) {
+    RibCandidate ca = {a, 0, 2, 1, 0, 0};
+    rib_update(routes[i].addr, routes[i].len, ca, &deltas);
+    if (i % 2 == 0) {
+      RibCandidate cb = {b, 1, 3, 1, 0, 0};
+      rib_update(routes[i].addr, routes[i].len, cb, &deltas);
+    }
+  }
+  fib_apply(deltas);
+  uint32_t backed = 0;
+  table.for_each([&](const RoutingTableEntry &entry) {
+    backed += entry.backup != 0;
+  });
+
+  const uint32_t n = 1000000;
+  vector<uint32_t> dsts(n);
+  for (uint32_t i = 0; i < n; i++) {
+    const RoutingTableEntry &r = routes[random_u32() % routes.size()];
+    dsts[i] = r.addr | (random_u32() & ~len_to_mask(r.len));
+  }
+  auto forward = [&](uint32_t *to_b) {
+    *to_b = 0;
+    double begin = now_ms();
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t nexthop, if_index;
+      query_flow(dsts[i], i, &nexthop, &if_index);
+      *to_b += nexthop == b;
+    }
+    return (now_ms() - begin) * 1e6 / n;
+  };
+  uint32_t to_b;
+  double up_ns = forward(&to_b);
+  printf("%zu routes, %u with a backup path\n", routes.size(), backed);
+  printf("A up:   %.1f ns/lookup, %.1f%% to B\n", up_ns, 100.0 * to_b / n);
+
+  double begin = now_ms();
+  adjacency_set_down(a, 0, true);
+  double flip_us = (now_ms() - begin) * 1000;
+  double down_ns = forward(&to_b);
+  printf("A down: %.1f ns/lookup, %.1f%% to B after a %.2f us flag flip\n", down_ns, 100.0 * to_b / n, flip_us);
+
+  deltas.clear();
+  begin = now_ms();
+  uint32_t withdrawn = rib_withdraw_neighbor(a, 0, &deltas);
+  fib_apply(deltas);
+  double repair_ms = now_ms() - begin;
+  printf("RIB withdraws %u routes of A and rewrites FIB in %.2f ms\n", withdrawn, repair_ms);
+}
+
+/*
+  环形拓扑上坏消息的收敛时间。路由器的状态都是全局变量，所以每个路由器 fork 成
+  一个进程，按 main.cpp 的方式处理 RIP 包和定时器（定时更新不分批，增量立即写入），
+  父进程按虚拟时间推进各个路由器，并把 RIP 包转给环上相邻的路由器，链路延迟 1 ms 。
+  路由器 r 的端口 1 连到 r+1 的端口 0 ，端口 2 是只有它自己的网段。全部路由器都学到
+  路由器 0 端口 2 的网段之后把这个网段断开，统计所有路由器删掉它用的时间和发送的 RIP 包数。
+*/
+#define RING_SIZE 8
+#define RING_LINK_DELAY 1
+#define RING_SETTLE (30 * 1000) // 全部学到之后再过这么久断开
+#define RING_LIMIT (3600 * 1000) // 虚拟时间上限
+
+struct RingMode {
+  const char *name;
+  bool poison_reverse; // 学到的路由以 metric 16 通告回去
+  bool withdraw; // 收到 metric 16 时删除候选，否则忽略、等它超时
+  bool urgent; // 路由失效时立即触发更新
+};
+
+// 父进程发给路由器的命令，之后是 packets 个 RingFrame 和包的内容
+struct RingCommand {
+  uint64_t time;
+  uint32_t fail; // 断开端口 2 的网段
+  uint32_t packets;
+};
+
+// 路由器的回复，之后是 packets 个 RingFrame 和包的内容
+struct RingReply {
+  uint64_t next; // 下一次需要推进的时刻
+  uint32_t reachable; // 是否有到路由器 0 端口 2 的网段的路由
+  uint32_t ecmp; // 到这个网段的路由是否是两个端口上的等价多路径
+  uint32_t packets;
+};
+
+struct RingFrame {
+  uint32_t if_index, len;
+};
+
+// 以下是子进程中一个路由器的状态
+RingMode ring_mode;
+uint32_t ring_trigger = 0;
+uint64_t ring_holdoff = 0;
+vector<uint8_t> ring_out;
+uint32_t ring_out_packets = 0;
+const uint32_t ring_multicast = (9 << 24) + 224;
+
+static bool read_full(int fd, void *buffer, size_t len) {
+  uint8_t *p = (uint8_t *)buffer;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void write_full(int fd, const void *buffer, size_t len) {
+  const uint8_t *p = (const uint8_t *)buffer;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0) {
+      perror("write");
+      exit(1);
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+static void ring_send(uint32_t if_index, const uint8_t *packet, uint32_t len) {
+  RingFrame frame = {if_index, len};
+  ring_out.insert(ring_out.end(), (const uint8_t *)&frame, (const uint8_t *)(&frame + 1));
+  ring_out.insert(ring_out.end(), packet, packet + len);
+  ring_out_packets++;
+}
+
+static bool has_withdrawal(const vector<FibDelta> &deltas) {
+  for (uint32_t i = 0; i < deltas.size(); i++) {
+    if (!deltas[i].insert) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 同 main.cpp 的 schedule_triggered_update
+static void ring_schedule_trigger(uint64_t time, bool urgent) {
+  urgent = urgent && ring_mode.urgent;
+  uint64_t expire = time;
+  if (!urgent) {
+    expire = time + 50 > ring_holdoff ? time + 50 : ring_holdoff;
+  }
+  RouterTimer timer = {.kind = TIMER_TRIGGERED_UPDATE};
+  if (ring_trigger == 0) {
+    ring_trigger = timer_add(expire, timer);
+  } else if (urgent) {
+    timer_modify(ring_trigger, expire);
+  }
+}
+
+static void ring_on_timer(const RouterTimer &timer) {
+  uint64_t time = timer_now();
+  vector<FibDelta> deltas;
+  switch (timer.kind) {
+  case TIMER_UPDATE: {
+    for (uint32_t j = 0; j < advert_chunks(timer.if_index); j++) {
+      uint32_t len;
+      const uint8_t *packet = advert_wire(timer.if_index, j, addrs[timer.if_index], ring_multicast, &len);
+      ring_send(timer.if_index, packet, len);
+    }
+    advert_changes_clear(timer.if_index);
+    RouterTimer next = {.kind = TIMER_UPDATE, .if_index = timer.if_index};
+    timer_add(time + UPDATE_INTERVAL - UPDATE_JITTER + rand() % (2 * UPDATE_JITTER + 1), next);
+    break;
+  }
+  case TIMER_TRIGGERED_UPDATE: {
+    ring_trigger = 0;
+    RipPacket rip;
+    uint8_t buffer[2048];
+    for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+      for (uint32_t j = 0; i < 2 && j < advert_changed_chunks(i); j++) {
+        advert_changed_packet(i, j, &rip);
+        uint32_t riplen = assemble(&rip, buffer);
+        uint32_t udplen = assembleUDP(buffer, riplen);
+        ring_send(i, buffer, assembleIP(buffer, udplen, addrs[i], ring_multicast));
+      }
+      advert_changes_clear(i);
+    }
+    ring_holdoff = time + 1000 + rand() % 4000;
+    break;
+  }
+  case TIMER_ROUTE_TIMEOUT:
+    if (rib_expire(timer.addr, timer.len, timer.nexthop, timer.if_index, time, &deltas)) {
+      fib_apply(deltas);
+      ring_schedule_trigger(time, has_withdrawal(deltas));
+    }
+    break;
+  case TIMER_ROUTE_GC:
+    advert_gc(timer.addr, timer.len);
+    break;
+  case TIMER_HOLDDOWN:
+    rib_holddown_end(timer.addr, timer.len);
+    break;
+  }
+}
+
+// 同 main.cpp 中对 response 的处理
+static void ring_receive(uint32_t if_index, const uint8_t *packet, uint32_t len, uint64_t time) {
+  RipView rip;
+  if (!parse_rip(packet, len, &rip) || rip.command != 2) {
+    return;
+  }
+  uint32_t src_addr;
+  memcpy(&src_addr, packet + 12, sizeof(src_addr));
+  uint64_t fingerprint = fp_compute(src_addr, if_index, rip);
+  uint32_t chunk = fp_lookup(fingerprint);
+  if (chunk != 0) {
+    fp_refresh(chunk, time);
+    return;
+  }
+  chunk = fp_create(fingerprint, src_addr, if_index, time);
+  uint32_t expected = 0;
+  bool trigger_flag = false;
+  bool withdrawals = false;
+  vector<FibDelta> deltas;
+  for (uint32_t i = 0; i < rip.numEntries; i++) {
+    uint32_t metric = rip.entries[i].metric_value();
+    uint32_t addr = rip.entries[i].addr & rip.entries[i].mask;
+    uint32_t len = __builtin_popcount(rip.entries[i].mask);
+    if (metric >= 15) {
+      if (ring_mode.withdraw) {
+        withdrawals = true;
+        trigger_flag = rib_withdraw(addr, len, src_addr, if_index, &deltas) || trigger_flag;
+      }
+      continue;
+    }
+    RibCandidate cand = {src_addr, if_index, metric + 1, time, 0, chunk};
+    expected++;
+    trigger_flag = rib_update(addr, len, cand, &deltas) || trigger_flag;
+  }
+  fp_commit(chunk, expected, withdrawals);
+  fib_apply(deltas);
+  if (trigger_flag) {
+    ring_schedule_trigger(time, has_withdrawal(deltas));
+  }
+}
+
+static void ring_router(uint32_t r, uint32_t n, int cmd_fd, int reply_fd) {
+  srand(r + 1);
+  // 端口 0 和端口 1 分别在与前后两个路由器之间的网段上
+  addrs[0] = 10 | (((r + n - 1) % n) << 8) | (1 << 16) | (2 << 24);
+  addrs[1] = 10 | (r << 8) | (1 << 16) | (1 << 24);
+  addrs[2] = 10 | (r << 8) | (2 << 16) | (1 << 24);
+  addrs[3] = 10 | (r << 8) | (3 << 16) | (1 << 24);
+  advert_set_poison_reverse(ring_mode.poison_reverse);
+  vector<FibDelta> deltas;
+  for (uint32_t i = 0; i < 3; i++) {
+    RibCandidate cand = {0, i, 1, 0, 0, 0};
+    rib_update(addrs[i] & 0x00FFFFFF, 24, cand, &deltas);
+  }
+  vector<RoutingTableEntry> initial;
+  rib_best_routes(&initial);
+  build(initial.data(), initial.size());
+  timer_start(0);
+  for (uint32_t i = 0; i < 2; i++) {
+    RouterTimer first_update = {.kind = TIMER_UPDATE, .if_index = i};
+    timer_add(i * UPDATE_INTERVAL / 2, first_update);
+  }
+  const uint32_t target = 10 | (2 << 16) | (1 << 24);
+  RingCommand cmd;
+  vector<uint8_t> packet;
+  while (read_full(cmd_fd, &cmd, sizeof(cmd))) {
+    timer_advance(cmd.time, ring_on_timer);
+    if (cmd.fail) {
+      deltas.clear();
+      rib_withdraw(addrs[2] & 0x00FFFFFF, 24, 0, 2, &deltas);
+      fib_apply(deltas);
+      ring_schedule_trigger(cmd.time, true);
+    }
+    for (uint32_t i = 0; i < cmd.packets; i++) {
+      RingFrame frame;
+      read_full(cmd_fd, &frame, sizeof(frame));
+      packet.resize(frame.len);
+      read_full(cmd_fd, packet.data(), frame.len);
+      ring_receive(frame.if_index, packet.data(), frame.len, cmd.time);
+    }
+    uint32_t nexthop, if_index, metric, other_nexthop, other_if;
+    bool reachable = query(target, &nexthop, &if_index, &metric);
+    // 按流分配时哈希值两端的流走不同的端口，就是有两条等价路径
+    bool ecmp = reachable && query_flow(target, 0, &nexthop, &if_index) &&
+                query_flow(target, 0xFFFFFFFF, &other_nexthop, &other_if) && if_index != other_if;
+    RingReply reply = {timer_next(cmd.time + RING_LIMIT), reachable, ecmp, ring_out_packets};
+    write_full(reply_fd, &reply, sizeof(reply));
+    write_full(reply_fd, ring_out.data(), ring_out.size());
+    ring_out.clear();
+    ring_out_packets = 0;
+  }
+}
+
+struct RingDelivery {
+  uint64_t time;
+  uint32_t router, if_index;
+  vector<uint8_t> packet;
+};
+
+static void ring_run(const RingMode &mode, uint32_t n) {
+  vector<int> cmd_fd(n), reply_fd(n);
+  vector<pid_t> pids(n);
+  ring_mode = mode;
+  for (uint32_t r = 0; r < n; r++) {
+    int to[2], from[2];
+    if (pipe(to) < 0 || pipe(from) < 0) {
+      perror("pipe");
+      exit(1);
+    }
+    pids[r] = fork();
+    if (pids[r] == 0) {
+      // 只留下自己的两端，父进程关闭管道时才能读到 EOF
+      for (uint32_t k = 0; k < r; k++) {
+        close(cmd_fd[k]);
+        close(reply_fd[k]);
+      }
+      close(to[1]);
+      close(from[0]);
+      ring_router(r, n, to[0], from[1]);
+      _exit(0);
+    }
+    close(to[0]);
+    close(from[1]);
+    cmd_fd[r] = to[1];
+    reply_fd[r] = from[0];
+  }
+
+  vector<uint64_t> next(n, 0);
+  vector<uint32_t> reachable(n, 0), ecmp(n, 0);
+  vector<RingDelivery> inflight;
+  uint64_t up = 0, fail = RING_LIMIT, down = RING_LIMIT;
+  uint32_t packets = 0, ecmp_routers = 0;
+  bool failed = false;
+  while (true) {
+    uint64_t time = failed ? RING_LIMIT : fail;
+    for (uint32_t r = 0; r < n; r++) {
+      time = std::min(time, next[r]);
+    }
+    for (uint32_t k = 0; k < inflight.size(); k++) {
+      time = std::min(time, inflight[k].time);
+    }
+    if (time >= RING_LIMIT) {
+      break;
+    }
+    bool fail_now = !failed && time == fail;
+    failed = failed || fail_now;
+    for (uint32_t r = 0; r < n; r++) {
+      vector<uint8_t> frames;
+      uint32_t count = 0;
+      for (uint32_t k = 0; k < inflight.size();) {
+        if (inflight[k].router == r && inflight[k].time == time) {
+          RingFrame frame = {inflight[k].if_index, (uint32_t)inflight[k].packet.size()};
+          frames.insert(frames.end(), (const uint8_t *)&frame, (const uint8_t *)(&frame + 1));
+          frames.insert(frames.end(), inflight[k].packet.begin(), inflight[k].packet.end());
+          count++;
+          inflight[k] = inflight.back();
+          inflight.pop_back();
+        } else {
+          k++;
+        }
+      }
+      bool fail_here = fail_now && r == 0;
+      if (next[r] > time && count == 0 && !fail_here) {
+        continue;
+      }
+      RingCommand cmd = {time, fail_here, count};
+      write_full(cmd_fd[r], &cmd, sizeof(cmd));
+      write_full(cmd_fd[r], frames.data(), frames.size());
+      RingReply reply;
+      read_full(reply_fd[r], &reply, sizeof(reply));
+      next[r] = reply.next;
+      reachable[r] = reply.reachable;
+      ecmp[r] = reply.ecmp;
+      if (failed) {
+        packets += reply.packets;
+      }
+      for (uint32_t i = 0; i < reply.packets; i++) {
+        RingFrame frame;
+        read_full(reply_fd[r], &frame, sizeof(frame));
+        RingDelivery delivery;
+        delivery.time = time + RING_LINK_DELAY;
+        delivery.packet.resize(frame.len);
+        read_full(reply_fd[r], delivery.packet.data(), frame.len);
+        // 端口 2 、3 上没有邻居
+        if (frame.if_index == 0) {
+          delivery.router = (r + n - 1) % n;
+          delivery.if_index = 1;
+        } else if (frame.if_index == 1) {
+          delivery.router = (r + 1) % n;
+          delivery.if_index = 0;
+        } else {
+          continue;
+        }
+        inflight.push_back(delivery);
+      }
+    }
+    uint32_t count = 0;
+    for (uint32_t r = 0; r < n; r++) {
+      count += reachable[r];
+    }
+    if (!failed && up == 0 && count == n) {
+      up = time;
+      fail = time + RING_SETTLE;
+    }
+    if (!failed && time < fail) {
+      ecmp_routers = 0;
+      for (uint32_t r = 0; r < n; r++) {
+        ecmp_routers += ecmp[r];
+      }
+    }
+    // 没有路由器有这个前缀、也没有在路上的包时，不会再有人学到它
+    if (failed && count == 0 && inflight.empty()) {
+      down = time;
+      break;
+    }
+  }
+  for (uint32_t r = 0; r < n; r++) {
+    close(cmd_fd[r]);
+    close(reply_fd[r]);
+    waitpid(pids[r], NULL, 0);
+  }
+  if (down == RING_LIMIT) {
+    printf("%-30s: up in %.3f s (%u ECMP), not converged in %d s\n", mode.name, up / 1000.0, ecmp_routers, RING_LIMIT / 1000);
+  } else {
+    printf("%-30s: up in %.3f s (%u ECMP), down in %.3f s, %u RIP packets\n", mode.name, up / 1000.0, ecmp_routers, (down - fail) / 1000.0, packets);
+  }
+}
+
+// 断开一个网段后，只做水平分割、忽略 metric 16 的路由器要等候选逐跳超时，
+// 毒性逆转加上撤销则逐跳立即删除。
+// 偶数个路由器的环上，正对路由器 0 的那个经两个端口等价多路径到达这个网段，
+// 两个端口都要毒性逆转或水平分割；奇数个时没有等价多路径，作为对照
+static void bench_ring(const char *path) {
+  RingMode modes[] = {
+    {"split horizon, wait timeout", false, false, false},
+    {"poisoned reverse, coalesced", true, true, false},
+    {"poisoned reverse, immediate", true, true, true}
+  };
+  uint32_t sizes[] = {RING_SIZE, RING_SIZE - 1};
+  for (uint32_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+    printf("%u routers in a ring, %d ms links\n", sizes[k], RING_LINK_DELAY);
+    for (uint32_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+      ring_run(modes[m], sizes[k]);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *name = argc > 1 ? argv[1] : "";
+  const char *path = argc > 2 ? argv[2] : "../../Setup/conf-part9.conf";
+  srand(1);
+  if (strcmp(name, "ecmp") == 0) {
+    bench_ecmp(path);
+  } else if (strcmp(name, "lookup") == 0) {
+    bench_lookup(path);
+  } else if (strcmp(name, "churn") == 0) {
+    bench_churn(path);
+  } else if (strcmp(name, "parse") == 0) {
+    bench_parse(path);
+  } else if (strcmp(name, "ingest") == 0) {
+    bench_ingest(path);
+  } else if (strcmp(name, "refresh") == 0) {
+    bench_refresh(path);
+  } else if (strcmp(name, "summary") == 0) {
+    bench_summary(path);
+  } else if (strcmp(name, "compress") == 0) {
+    bench_compress(path);
+  } else if (strcmp(name, "forward") == 0) {
+    bench_forward(path);
+  } else if (strcmp(name, "failover") == 0) {
+    bench_failover(path);
+  } else if (strcmp(name, "ring") == 0) {
+    bench_ring(path);
+  } else {
+    printf("usage: %s ecmp|lookup|churn|parse|ingest|refresh|summary|compress|forward|failover|ring [route file]\n", argv[0]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,289 @@
+#include "router.h"
+#include "timer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <unordered_map>
+
+/*
+  邻居存活检测，按 BFD（RFC 5880 的异步模式，单跳见 RFC 5881）的控制包格式和状态机。
+  RIP 要等 ROUTE_TIMEOUT 才发现邻居失效，BFD 每 BFD_INTERVAL 毫秒互发一个控制包，
+  连续 BFD_MULTIPLIER 个间隔收不到就认为邻居失效：转发面立即把它标记为失效，
+  以它为主路径的表项改用备份路径（见 nexthop.cpp），再由调用者删除经过它的所有路由。
+
+  每个邻居 (地址, 端口) 一个会话，状态为 Down -> Init -> Up 的三次握手。BFD_PORTS
+  中的端口收到邻居的 RIP response 时主动建立会话；其余端口是被动的（RFC5880 6.1），
+  收到邻居的 BFD 包才建立会话并开始发送，所以不运行 BFD 的邻居（如 BIRD）收不到 BFD 包。
+  两端至少一端要主动。只有到过 Up 的会话失效时才报告。收到过 BFD 包、但会话不是 Up 的邻居的 RIP 通告被忽略，避免刚失效的邻居
+  的路由又被学回来。Down 状态按 RFC 的要求每秒只发一个包，BFD_FORGET 内没有收到过
+  它的包则删除会话。发送和检测都是时间轮中每个会话一个定时器，收包只查一次哈希表，
+  与会话个数无关。不实现回声（echo）和认证。
+*/
+
+#define BFD_PORT 3784
+#define BFD_SLOW_INTERVAL 1000 // 不是 Up 时的发送间隔，RFC5880 6.8.3
+#define BFD_FORGET ROUTE_TIMEOUT // Down 的会话这么久收不到包则删除
+
+enum BfdState {
+  BFD_ADMIN_DOWN = 0,
+  BFD_DOWN = 1,
+  BFD_INIT = 2,
+  BFD_UP = 3
+};
+
+// 诊断码，RFC5880 4.1
+#define BFD_DIAG_NONE 0
+#define BFD_DIAG_EXPIRED 1 // 检测超时
+#define BFD_DIAG_NEIGHBOR_DOWN 3 // 对方报告 Down
+
+struct BfdSession {
+  uint32_t state;
+  uint32_t diag;
+  uint32_t local_discr, remote_discr;
+  uint32_t remote_multiplier;
+  uint32_t remote_min_tx, remote_min_rx; // 对方的期望发送间隔、要求的接收间隔，毫秒
+  bool heard; // 收到过它的 BFD 包
+  uint32_t tx_timer, detect_timer;
+};
+
+std::unordered_map<uint64_t, BfdSession> bfd_sessions; // (邻居地址, 端口) -> 会话
+std::unordered_map<uint32_t, uint64_t> bfd_discrs; // 本地 discriminator -> 会话的键
+uint32_t bfd_next_discr = 1;
+
+extern uint32_t assembleIP(uint8_t *buffer, uint32_t udplen, uint32_t src, uint32_t dst);
+extern uint16_t ipHeaderChecksum(const uint8_t *buffer);
+extern uint32_t timer_add(uint64_t expire, RouterTimer timer);
+extern void timer_modify(uint32_t id, uint64_t expire);
+extern void timer_cancel(uint32_t id);
+extern void adjacency_set_down(uint32_t nexthop, uint32_t if_index, bool down);
+
+static inline uint64_t session_key(uint32_t addr, uint32_t if_index) {
+  return ((uint64_t)addr << 32) | if_index;
+}
+
+static inline uint32_t read_u32(const uint8_t *p) {
+  return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void write_u32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+// 不是 Up 时发送间隔至少一秒
+static uint32_t desired_min_tx(const BfdSession &s) {
+  return s.state == BFD_UP ? BFD_INTERVAL : BFD_SLOW_INTERVAL;
+}
+
+// 协商后的发送间隔，RFC5880 6.8.7
+static uint32_t tx_interval(const BfdSession &s) {
+  uint32_t interval = desired_min_tx(s);
+  return s.remote_min_rx > interval ? s.remote_min_rx : interval;
+}
+
+// 检测时间，RFC5880 6.8.4
+static uint32_t detect_time(const BfdSession &s) {
+  uint32_t interval = s.remote_min_tx > BFD_INTERVAL ? s.remote_min_tx : BFD_INTERVAL;
+  return s.remote_multiplier * interval;
+}
+
+// 下一次发送，间隔随机缩短到 75%~100%
+static void schedule_tx(uint32_t addr, uint32_t if_index, BfdSession &s, uint64_t time) {
+  uint32_t interval = tx_interval(s);
+  RouterTimer timer = {.kind = TIMER_BFD_TX, .addr = addr, .len = 0, .nexthop = 0, .if_index = if_index};
+  s.tx_timer = timer_add(time + interval - rand() % (interval / 4 + 1), timer);
+}
+
+static BfdSession &create(uint32_t addr, uint32_t if_index, uint64_t time) {
+  uint64_t key = session_key(addr, if_index);
+  BfdSession &s = bfd_sessions[key];
+  s.state = BFD_DOWN;
+  s.diag = BFD_DIAG_NONE;
+  s.local_discr = bfd_next_discr++;
+  s.remote_discr = 0;
+  s.remote_multiplier = BFD_MULTIPLIER;
+  s.remote_min_tx = BFD_SLOW_INTERVAL;
+  s.remote_min_rx = 1;
+  s.heard = false;
+  bfd_discrs[s.local_discr] = key;
+  RouterTimer detect = {.kind = TIMER_BFD_DETECT, .addr = addr, .len = 0, .nexthop = 0, .if_index = if_index};
+  s.detect_timer = timer_add(time + BFD_FORGET, detect);
+  // 第一个包马上发出
+  RouterTimer tx = {.kind = TIMER_BFD_TX, .addr = addr, .len = 0, .nexthop = 0, .if_index = if_index};
+  s.tx_timer = timer_add(time, tx);
+  return s;
+}
+
+/**
+ * @brief 收到邻居的 RIP response ，端口主动发起 BFD 且还没有会话时建立一个，开始向它发送 BFD 包
+ */
+void bfd_discover(uint32_t addr, uint32_t if_index, uint64_t time) {
+  if (!(BFD_PORTS & (1u << if_index))) {
+    return;
+  }
+  if (bfd_sessions.find(session_key(addr, if_index)) == bfd_sessions.end()) {
+    create(addr, if_index, time);
+  }
+}
+
+/**
+ * @brief 是否应当忽略这个邻居的 RIP 通告：它运行 BFD ，但会话不是 Up
+ */
+bool bfd_blocked(uint32_t addr, uint32_t if_index) {
+  std::unordered_map<uint64_t, BfdSession>::const_iterator it = bfd_sessions.find(session_key(addr, if_index));
+  return it != bfd_sessions.end() && it->second.heard && it->second.state != BFD_UP;
+}
+
+/**
+ * @brief 处理一个收到的 IP 包，如果它是发给本机的 BFD 控制包
+ * @param packet IP 包，已经检查过 IP 校验和
+ * @param down 会话从 Up 变为 Down 时写入 true ，调用者应删除经过这个邻居的路由
+ * @return 是否是 BFD 包，是则不需要再按 RIP 处理
+ */
+bool bfd_receive(uint32_t src_addr, uint32_t if_index, const uint8_t *packet, uint32_t len, uint64_t time, bool *down) {
+  *down = false;
+  if (len < 20 || (packet[0] >> 4) != 4 || packet[9] != 17) {
+    return false;
+  }
+  uint32_t ihl = (packet[0] & 0xF) * 4;
+  if (len < ihl + 8) {
+    return false;
+  }
+  const uint8_t *udp = packet + ihl;
+  if (((udp[2] << 8) | udp[3]) != BFD_PORT) {
+    return false;
+  }
+  const uint8_t *bfd = udp + 8;
+  // RFC5881 5: 单跳会话的 TTL 必须是 255 ；RFC5880 6.8.6 的检查，不支持认证（A 位）
+  if (packet[8] != 255 || len < ihl + 8 + 24 || (bfd[0] >> 5) != 1 || bfd[3] < 24 || ihl + 8 + bfd[3] > len ||
+      bfd[2] == 0 || (bfd[1] & 0x05) != 0 || read_u32(bfd + 4) == 0) {
+    return true;
+  }
+  uint32_t your_discr = read_u32(bfd + 8);
+  uint32_t state = bfd[1] >> 6;
+  if (your_discr == 0 && state != BFD_DOWN && state != BFD_ADMIN_DOWN) {
+    return true;
+  }
+  uint64_t key = session_key(src_addr, if_index);
+  std::unordered_map<uint64_t, BfdSession>::iterator it = bfd_sessions.find(key);
+  if (your_discr != 0) {
+    std::unordered_map<uint32_t, uint64_t>::const_iterator d = bfd_discrs.find(your_discr);
+    if (d == bfd_discrs.end() || d->second != key) {
+      return true;
+    }
+  }
+  BfdSession &s = it != bfd_sessions.end() ? it->second : create(src_addr, if_index, time);
+  s.heard = true;
+  s.remote_discr = read_u32(bfd + 4);
+  s.remote_multiplier = bfd[2];
+  s.remote_min_tx = (read_u32(bfd + 12) + 999) / 1000;
+  s.remote_min_rx = (read_u32(bfd + 16) + 999) / 1000;
+
+  // 状态机，RFC5880 6.8.6
+  uint32_t old = s.state;
+  if (state == BFD_ADMIN_DOWN) {
+    if (s.state != BFD_DOWN) {
+      s.state = BFD_DOWN;
+      s.diag = BFD_DIAG_NEIGHBOR_DOWN;
+    }
+  } else if (s.state == BFD_DOWN) {
+    if (state == BFD_DOWN) {
+      s.state = BFD_INIT;
+    } else if (state == BFD_INIT) {
+      s.state = BFD_UP;
+    }
+  } else if (s.state == BFD_INIT) {
+    if (state == BFD_INIT || state == BFD_UP) {
+      s.state = BFD_UP;
+    }
+  } else if (state == BFD_DOWN) {
+    s.state = BFD_DOWN;
+    s.diag = BFD_DIAG_NEIGHBOR_DOWN;
+  }
+  if (s.state == BFD_UP) {
+    s.diag = BFD_DIAG_NONE;
+  }
+  *down = old == BFD_UP && s.state == BFD_DOWN && state != BFD_ADMIN_DOWN;
+  if (*down || s.state == BFD_UP) {
+    adjacency_set_down(src_addr, if_index, *down);
+  }
+
+  timer_modify(s.detect_timer, time + (s.state == BFD_DOWN ? BFD_FORGET : detect_time(s)));
+  if (s.state != old) {
+    // 状态变化马上告诉对方
+    timer_modify(s.tx_timer, time);
+  }
+  return true;
+}
+
+/**
+ * @brief 发送定时器到期，组装发给这个邻居的 BFD 控制包，并安排下一次发送
+ * @param src 本机在这个端口上的地址
+ * @param buffer 写入 IP 包
+ * @return IP 包的长度
+ */
+uint32_t bfd_send(uint32_t addr, uint32_t if_index, uint32_t src, uint8_t *buffer, uint64_t time) {
+  BfdSession &s = bfd_sessions[session_key(addr, if_index)];
+  uint8_t *udp = buffer + 20;
+  uint8_t *bfd = udp + 8;
+  bfd[0] = (1 << 5) | s.diag;
+  bfd[1] = s.state << 6;
+  bfd[2] = BFD_MULTIPLIER;
+  bfd[3] = 24;
+  write_u32(bfd + 4, s.local_discr);
+  write_u32(bfd + 8, s.remote_discr);
+  write_u32(bfd + 12, desired_min_tx(s) * 1000);
+  write_u32(bfd + 16, BFD_INTERVAL * 1000);
+  write_u32(bfd + 20, 0); // 不支持 echo
+  // RFC5881 4: 源端口 49152-65535
+  uint32_t sport = 49152 + (s.local_discr & 0x3FFF);
+  udp[0] = sport >> 8;
+  udp[1] = sport & 0xFF;
+  udp[2] = BFD_PORT >> 8;
+  udp[3] = BFD_PORT & 0xFF;
+  udp[4] = 0;
+  udp[5] = 8 + 24;
+  udp[6] = 0;
+  udp[7] = 0;
+  uint32_t len = assembleIP(buffer, 8 + 24, src, addr);
+  buffer[8] = 255;
+  uint16_t sum = ipHeaderChecksum(buffer);
+  buffer[10] = sum >> 8;
+  buffer[11] = sum & 0xFF;
+  schedule_tx(addr, if_index, s, time);
+  return len;
+}
+
+/**
+ * @brief 发送定时器到期但端口还不能发送：不发包，只安排下一次发送
+ */
+void bfd_defer(uint32_t addr, uint32_t if_index, uint64_t time) {
+  schedule_tx(addr, if_index, bfd_sessions[session_key(addr, if_index)], time);
+}
+
+/**
+ * @brief 检测定时器到期：Init/Up 的会话变为 Down ，Down 的会话被删除
+ * @return 会话是否从 Up 变为 Down ，是则调用者应删除经过这个邻居的路由
+ */
+bool bfd_expire(uint32_t addr, uint32_t if_index, uint64_t time) {
+  std::unordered_map<uint64_t, BfdSession>::iterator it = bfd_sessions.find(session_key(addr, if_index));
+  BfdSession &s = it->second;
+  if (s.state == BFD_DOWN) {
+    timer_cancel(s.tx_timer);
+    bfd_discrs.erase(s.local_discr);
+    bfd_sessions.erase(it);
+    return false;
+  }
+  bool was_up = s.state == BFD_UP;
+  if (was_up) {
+    adjacency_set_down(addr, if_index, true);
+  }
+  s.state = BFD_DOWN;
+  s.diag = BFD_DIAG_EXPIRED;
+  s.remote_discr = 0;
+  RouterTimer detect = {.kind = TIMER_BFD_DETECT, .addr = addr, .len = 0, .nexthop = 0, .if_index = if_index};
+  s.detect_timer = timer_add(time + BFD_FORGET, detect);
+  timer_modify(s.tx_timer, time);
+  return was_up;
+}
@@ -0,0 +1,147 @@
+#include "router.h"
+#include "router_hal.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+  解析 Setup/ 下 bird 风格的静态路由文件，每行形如：
+    route 1.51.0.0/16 via "wlan0";
+    route 10.1.0.0/24 via 192.168.3.2;
+  '#' 开始到行尾是注释，其它语句会被跳过。
+  整个文件一次读入内存后用指针逐字节扫描，不使用 sscanf，几千行的文件也只需要一趟。
+*/
+
+static const char *skip_space(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+static const char *skip_line(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    p++;
+  }
+  return p < end ? p + 1 : p;
+}
+
+// 解析点分十进制地址，结果为大端序，失败返回 NULL
+static const char *parse_ip(const char *p, const char *end, uint32_t *addr) {
+  uint32_t res = 0;
+  for (int i = 0; i < 4; i++) {
+    uint32_t part = 0;
+    const char *begin = p;
+    while (p < end && *p >= '0' && *p <= '9' && p - begin < 3) {
+      part = part * 10 + (*p - '0');
+      p++;
+    }
+    if (p == begin || part > 255) {
+      return NULL;
+    }
+    res |= part << (i * 8);
+    if (i < 3) {
+      if (p >= end || *p != '.') {
+        return NULL;
+      }
+      p++;
+    }
+  }
+  *addr = res;
+  return p;
+}
+
+/**
+ * @brief 从 bird 风格的配置文件中读取静态路由
+ * @param path 配置文件路径
+ * @param if_addrs 各端口的地址，用于判断 via 地址所在的端口（按 /24 直连网段匹配）
+ * @param default_if via 为接口名时使用的出端口
+ * @param res 解析出的表项追加到 *res 后面，metric 为 1
+ * @return 读入的路由条数，文件无法打开时返回 -1
+ *
+ * via 为接口名时视为直连路由（nexthop 为 0）；via 为地址时，
+ * 如果地址不在任何一个直连网段内，这条路由会被跳过。
+ */
+int load_static_routes(const char *path, const uint32_t *if_addrs, uint32_t default_if, vector<RoutingTableEntry> *res) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return -1;
+  }
+  // 管道、FIFO 没有长度，边读边扩大缓冲区
+  vector<char> buffer;
+  char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+    buffer.insert(buffer.end(), chunk, chunk + n);
+  }
+  fclose(fp);
+
+  int count = 0;
+  const char *p = buffer.data();
+  const char *end = p + buffer.size();
+  while (p < end) {
+    const char *line = p;
+    p = skip_space(p, end);
+    if (end - p < 6 || p[0] != 'r' || p[1] != 'o' || p[2] != 'u' || p[3] != 't' || p[4] != 'e' || (p[5] != ' ' && p[5] != '\t')) {
+      p = skip_line(p, end);
+      continue;
+    }
+    p = skip_space(p + 5, end);
+
+    uint32_t addr, len = 0, nexthop = 0, if_index = default_if;
+    p = parse_ip(p, end, &addr);
+    if (p == NULL || p >= end || *p != '/') {
+      p = skip_line(line, end);
+      continue;
+    }
+    p++;
+    // 前缀长度是一到两位数字
+    uint32_t digits = 0;
+    while (p < end && *p >= '0' && *p <= '9' && digits < 3) {
+      len = len * 10 + (*p - '0');
+      p++;
+      digits++;
+    }
+    if (digits == 0 || digits > 2) {
+      p = skip_line(p, end);
+      continue;
+    }
+    p = skip_space(p, end);
+    if (len > 32 || end - p < 4 || p[0] != 'v' || p[1] != 'i' || p[2] != 'a') {
+      p = skip_line(p, end);
+      continue;
+    }
+    p = skip_space(p + 3, end);
+    if (p < end && *p != '"') {
+      p = parse_ip(p, end, &nexthop);
+      if (p == NULL) {
+        p = skip_line(line, end);
+        continue;
+      }
+      bool found = false;
+      for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+        if (((nexthop ^ if_addrs[i]) & 0x00FFFFFF) == 0) {
+          if_index = i;
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        p = skip_line(p, end);
+        continue;
+      }
+    }
+
+    RoutingTableEntry entry = {
+      .addr = addr & len_to_mask(len),
+      .len = len,
+      .if_index = if_index,
+      .nexthop = nexthop,
+      .metric = 1
+    };
+    res->push_back(entry);
+    count++;
+    p = skip_line(p, end);
+  }
+  return count;
+}
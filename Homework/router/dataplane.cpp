@@ -0,0 +1,100 @@
+#include "router.h"
+#include "router_hal.h"
+#include "shm_fib.h"
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A forwarding process for the shared FIB published by the router started
+// with SHM_FIB set, see shm_fib.cpp. It maps the FIB read-only and never
+// writes to it, so any number of them can run, each on its own ports and CPU,
+// and one that crashes or restarts forwards again as soon as it is up.
+//
+// usage: ./dataplane [port mask] [cpu], e.g. ./dataplane 3 2 forwards
+// packets received on ports 0 and 1 on CPU 2; by default all ports, any CPU
+
+extern bool forward_fast(uint8_t *packet, size_t len);
+extern uint32_t flow_hash(const uint8_t *packet, size_t len);
+
+uint8_t packet[2048];
+in_addr_t multicast_addr = (9 << 24) + 224;
+
+int main(int argc, char *argv[]) {
+  ShmFib<NextHopGroup> fib;
+  if (!fib.open(SHM_FIB_NAME)) {
+    printf("Shared FIB %s not found, start the router with SHM_FIB set first\n", SHM_FIB_NAME);
+    return 1;
+  }
+  int mask = argc > 1 ? strtol(argv[1], NULL, 0) : (1 << N_IFACE_ON_BOARD) - 1;
+  mask &= (1 << N_IFACE_ON_BOARD) - 1;
+  if (argc > 2) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(atoi(argv[2]), &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+      printf("Failed to pin to CPU %s\n", argv[2]);
+    }
+  }
+
+  // the addresses are the router's, ARP requests for unknown neighbors use them
+  in_addr_t addrs[N_IFACE_ON_BOARD];
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    addrs[i] = i < fib.ports() ? fib.port_addr(i) : 0;
+  }
+  int res = HAL_Init(0, addrs);
+  if (res < 0) {
+    return res;
+  }
+  printf("Forwarding on ports %#x, FIB generation %u\n", mask, fib.generation());
+
+  while (1) {
+    macaddr_t src_mac;
+    macaddr_t dst_mac;
+    int if_index;
+    res = HAL_ReceiveIPPacket(mask, packet, sizeof(packet), src_mac, dst_mac,
+                              1000, &if_index);
+    if (res == HAL_ERR_EOF) {
+      break;
+    } else if (res < 20 || res > sizeof(packet)) {
+      // timeout, error, truncated or too short for an IP header
+      continue;
+    }
+
+    in_addr_t dst_addr = (packet[16]) | (packet[17] << 8) | (packet[18] << 16) | (packet[19] << 24);
+    // packets for the router itself are handled by the router process,
+    // which receives them on its own; addresses follow port changes
+    bool dst_is_me = dst_addr == multicast_addr;
+    for (uint32_t i = 0; i < N_IFACE_ON_BOARD && !dst_is_me; i++) {
+      dst_is_me = dst_addr == fib.port_addr(i);
+    }
+    // header checks, ttl and checksum in one pass, see forward_fast
+    if (dst_is_me || !forward_fast(packet, res)) {
+      continue;
+    }
+
+    NextHopGroup group;
+    if (!fib.lookup(dst_addr, &group)) {
+      continue;
+    }
+    // equal-cost routes are spread per flow, as in the router
+    uint32_t i = ((uint64_t)flow_hash(packet, res) * group.size) >> 32;
+    uint32_t nexthop = group.nexthop[i];
+    uint32_t dest_if = group.if_index[i];
+    if (nexthop == 0) {
+      nexthop = dst_addr;
+    }
+    if (dest_if >= N_IFACE_ON_BOARD) {
+      continue;
+    }
+    // RIP neighbors are published by the router, direct hosts need ARP
+    macaddr_t dest_mac;
+    if (!fib.neighbor(nexthop, dest_if, dest_mac) &&
+        HAL_ArpGetMacAddress(dest_if, nexthop, dest_mac) != 0) {
+      continue;
+    }
+    HAL_SendIPPacket(dest_if, packet, res, dest_mac);
+  }
+  return 0;
+}
@@ -1 +1,3 @@
-#define DEBUG_OUTPUT
\ No newline at end of file
+#ifndef NO_DEBUG_OUTPUT
+#define DEBUG_OUTPUT
+#endif
@@ -0,0 +1,178 @@
+#include "rip.h"
+#include "router.h"
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+
+/*
+  邻居每隔一段时间就把同样的整张表重发一遍。对每个收到的 RIP 包按 (邻居, 内容) 计算
+  64 位指纹，完整处理过一次的包记为一个 chunk ，RIB 中由它产生的候选都指向这个 chunk 。
+  之后收到指纹相同的包时只更新 chunk 的 last_seen ，不再逐项查询、更新 RIB ；
+  候选的超时定时器到期时再看 chunk 的 last_seen ，顺延到真正超时的时刻。
+  只要有一个候选不再指向某个 chunk（被替换、撤销或超时），这个 chunk 就不能再匹配，
+  下一次收到同样的包会重新完整处理。
+  只有校验过表项的包才有 chunk ，所以收到的包只需校验头部就可以查指纹，
+  命中时跳过逐项校验（parse_rip_header 和 rip_entries_valid）。
+
+  metric 16 的表项是撤销，不产生候选。含撤销的包处理完时记下这个邻居的纪元，
+  之后这个邻居每带来一个新候选纪元就加一：被撤销的前缀可能又从它那里学到了，
+  同样的包不能再跳过，纪元不同时按不匹配处理。
+*/
+
+struct Chunk {
+  uint64_t fingerprint;
+  uint64_t last_seen;
+  uint64_t neighbor; // (邻居地址, 端口)
+  uint32_t epoch; // 含撤销时，处理完时邻居的纪元
+  uint32_t refs; // 指向它的候选个数
+  bool indexed; // 是否在 chunk_index 中，即可以走快速路径
+  bool withdrawals; // 是否含撤销
+};
+
+vector<Chunk> chunks(1); // 0 号不使用
+vector<uint32_t> free_chunks;
+std::unordered_map<uint64_t, uint32_t> chunk_index; // 指纹 -> chunks 的下标
+std::unordered_map<uint64_t, uint32_t> epochs; // (邻居地址, 端口) -> 纪元
+
+static inline uint64_t mix(uint64_t h, uint64_t v) {
+  h ^= v;
+  h *= 0xff51afd7ed558ccdULL;
+  return h ^ (h >> 32);
+}
+
+/**
+ * @brief 计算一个 RIP 包的指纹，包括来源邻居、命令和所有表项
+ */
+uint64_t fp_compute(uint32_t src_addr, uint32_t if_index, const RipView &rip) {
+  uint64_t h = mix(((uint64_t)src_addr << 32) | if_index, ((uint64_t)rip.command << 32) | rip.numEntries);
+  const uint8_t *p = (const uint8_t *)rip.entries;
+  uint32_t len = rip.numEntries * sizeof(RipWireEntry);
+  uint32_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, p + i, sizeof(v));
+    h = mix(h, v);
+  }
+  // 表项是 20 字节，总长度是 4 的倍数
+  if (i < len) {
+    uint32_t v;
+    memcpy(&v, p + i, sizeof(v));
+    h = mix(h, v);
+  }
+  return h;
+}
+
+/**
+ * @brief 查找可以走快速路径的 chunk
+ * @return chunk 编号，没有则返回 0
+ */
+uint32_t fp_lookup(uint64_t fingerprint) {
+  std::unordered_map<uint64_t, uint32_t>::const_iterator it = chunk_index.find(fingerprint);
+  if (it == chunk_index.end()) {
+    return 0;
+  }
+  const Chunk &chunk = chunks[it->second];
+  if (chunk.withdrawals && chunk.epoch != epochs[chunk.neighbor]) {
+    return 0;
+  }
+  return it->second;
+}
+
+/**
+ * @brief 快速路径：同样的包又收到一次
+ */
+void fp_refresh(uint32_t id, uint64_t time) {
+  chunks[id].last_seen = time;
+}
+
+uint64_t fp_last_seen(uint32_t id) {
+  return chunks[id].last_seen;
+}
+
+/**
+ * @brief 为一个需要完整处理的包新建 chunk ，处理完后调用 fp_commit
+ */
+uint32_t fp_create(uint64_t fingerprint, uint32_t src_addr, uint32_t if_index, uint64_t time) {
+  uint32_t id;
+  if (!free_chunks.empty()) {
+    id = free_chunks.back();
+    free_chunks.pop_back();
+  } else {
+    id = chunks.size();
+    chunks.push_back(Chunk());
+  }
+  Chunk &chunk = chunks[id];
+  chunk.fingerprint = fingerprint;
+  chunk.last_seen = time;
+  chunk.neighbor = ((uint64_t)src_addr << 32) | if_index;
+  chunk.epoch = 0;
+  chunk.refs = 0;
+  chunk.indexed = false;
+  chunk.withdrawals = false;
+  return id;
+}
+
+static void release(uint32_t id) {
+  if (chunks[id].indexed) {
+    chunk_index.erase(chunks[id].fingerprint);
+    chunks[id].indexed = false;
+  }
+  free_chunks.push_back(id);
+}
+
+/**
+ * @brief 包处理完毕，包中 expected 项都成为了指向它的候选时，之后同样的包走快速路径
+ * @param withdrawals 包中是否有 metric 16 的表项
+ */
+void fp_commit(uint32_t id, uint32_t expected, bool withdrawals) {
+  Chunk &chunk = chunks[id];
+  if (chunk.refs == 0) {
+    // 全是撤销的包没有候选维持 chunk 的生命周期，每次都完整处理
+    release(id);
+    return;
+  }
+  if (chunk.refs != expected) {
+    return;
+  }
+  if (withdrawals) {
+    chunk.withdrawals = true;
+    chunk.epoch = epochs[chunk.neighbor];
+  }
+  // 同一个邻居的上一个同样的包的 chunk 被取代，不再匹配
+  std::unordered_map<uint64_t, uint32_t>::iterator it = chunk_index.find(chunk.fingerprint);
+  if (it != chunk_index.end()) {
+    chunks[it->second].indexed = false;
+    it->second = id;
+  } else {
+    chunk_index[chunk.fingerprint] = id;
+  }
+  chunk.indexed = true;
+}
+
+/**
+ * @brief 一个候选开始指向 chunk
+ */
+void fp_link(uint32_t id) {
+  chunks[id].refs++;
+}
+
+/**
+ * @brief 邻居带来了一个之前没有的候选，它之前含撤销的包都不能再跳过
+ */
+void fp_learned(uint32_t id) {
+  epochs[chunks[id].neighbor]++;
+}
+
+/**
+ * @brief 一个候选不再指向 chunk ，chunk 从此不能匹配，没有候选指向时回收
+ */
+void fp_unlink(uint32_t id) {
+  Chunk &chunk = chunks[id];
+  if (chunk.indexed) {
+    chunk_index.erase(chunk.fingerprint);
+    chunk.indexed = false;
+  }
+  if (--chunk.refs == 0) {
+    release(id);
+  }
+}
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * @brief 进行转发时所需的 IP 头的更新：
@@ -39,3 +40,81 @@ bool forward(uint8_t *packet, size_t len) {
   packet[11] = checksum_new & 0x00FF;  
   return true;
 }
+
+
+/**
+ * @brief 计算报文的流哈希，用于在等价多路径中选择下一跳
+ * @param packet IP 包
+ * @param len 即 packet 的长度，单位为字节
+ * @return 由源、目的地址以及 TCP/UDP 端口决定的哈希值，同一个流的报文哈希相同
+ *
+ * 分片报文（除第一片外没有 L4 头）以及其它协议只使用地址，
+ * 这样同一个流的所有分片仍然走同一条路径。
+ */
+uint32_t flow_hash(const uint8_t *packet, size_t len) {
+  uint32_t src = packet[12] | (packet[13] << 8) | (packet[14] << 16) | (packet[15] << 24);
+  uint32_t dst = packet[16] | (packet[17] << 8) | (packet[18] << 16) | (packet[19] << 24);
+  uint64_t h = ((uint64_t)src << 32) | dst;
+  uint32_t ihl = (packet[0] & 0x0F) << 2;
+  bool fragmented = ((packet[6] & 0x3F) | packet[7]) != 0;
+  if ((packet[9] == 6 || packet[9] == 17) && !fragmented && len >= ihl + 4) {
+    uint32_t ports = (packet[ihl] << 24) | (packet[ihl + 1] << 16) | (packet[ihl + 2] << 8) | packet[ihl + 3];
+    h ^= (uint64_t)ports * 0x9E3779B97F4A7C15ULL;
+  }
+  // murmur3 的 64 位收尾混合
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return (uint32_t)h;
+}
+
+/**
+ * @brief 转发的快速路径，对 IP 头只扫描一遍，完成 validateIPChecksum 和 forward 的全部工作：
+ *        检查版本、首部长度、总长度、校验和与 TTL ，然后原地把 TTL 减一，
+ *        并按 RFC 1624 的公式 HC' = ~(~HC + ~m + m') 增量更新校验和
+ * @param packet 收到的 IP 包，既是输入也是输出，原地更改
+ * @param len 即 packet 的长度，单位为字节
+ * @return 可以转发则返回 true ；首部不合法、校验和有误或 TTL 减一后为 0 时返回 false ，报文应当丢弃
+ *
+ * 没有选项的 20 字节首部是绝大多数，按 5 个 32 位字展开求和；带选项的首部逐字循环。
+ * 反码和与字节序无关，所以直接按本机字节序累加，全部加起来是 0xFFFF 即校验和正确。
+ */
+bool forward_fast(uint8_t *packet, size_t len) {
+  if (len < 20) {
+    return false;
+  }
+  uint32_t ihl = (packet[0] & 0x0F) << 2;
+  uint32_t total = (packet[2] << 8) | packet[3];
+  // 链路层可能在末尾填充，总长度可以比收到的短
+  if ((packet[0] >> 4) != 4 || ihl < 20 || total < ihl || total > len || packet[8] <= 1) {
+    return false;
+  }
+  uint32_t w[5];
+  memcpy(w, packet, sizeof(w));
+  uint64_t sum = (uint64_t)w[0] + w[1] + w[2] + w[3] + w[4];
+  if (ihl > 20) {
+    // 慢速路径：选项
+    for (uint32_t i = 20; i < ihl; i += 4) {
+      uint32_t option;
+      memcpy(&option, packet + i, sizeof(option));
+      sum += option;
+    }
+  }
+  sum = (sum >> 32) + (sum & 0xFFFFFFFF);
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  if (sum != 0xFFFF) {
+    return false;
+  }
+  // TTL 所在的 16 位字 m 减少 0x0100 ，~m + m' 恒为 0xFEFF
+  packet[8]--;
+  uint32_t check = (~((packet[10] << 8) | packet[11]) & 0xFFFF) + 0xFEFF;
+  check = (check >> 16) + (check & 0xFFFF);
+  check = ~check & 0xFFFF;
+  packet[10] = check >> 8;
+  packet[11] = check & 0xFF;
+  return true;
+}
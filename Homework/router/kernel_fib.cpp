@@ -0,0 +1,344 @@
+#include "router.h"
+#include "prefix_hash.h"
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+
+/*
+  把最优路由写入 Linux 内核的路由表（KERNEL_TABLE 不为 0 时），由内核转发，
+  用户态只运行 RIP 控制面。路由表的每次变化经 kfib_update 暂存，同一个前缀只保留
+  最后一次，fib_commit 时由 kfib_flush 与已知的内核状态比较，只把真正变化的前缀
+  拼成一批 rtnetlink 消息（RTM_NEWROUTE 带 NLM_F_REPLACE ，或 RTM_DELROUTE）一次发送。
+  启动时先读出内核表中 protocol 为 RTPROT_RIP 的路由作为已知状态，建表后删除多余的，
+  所以重启路由器不会留下过时的路由，也不会重写没有变化的。
+
+  直连路由由内核自己维护，不写入。只写网关，出端口由内核按网关所在的直连网段决定，
+  所以不需要 HAL 端口编号到内核网卡的对应关系。等价多路径写成 RTA_MULTIPATH 。
+  内核在 sendmsg 中同步处理 rtnetlink 请求，不带 NLM_F_ACK 时只有失败的请求有回复，
+  发送后不阻塞地读出即可。
+
+  例如 make KERNEL_TABLE=254 ，在 network namespace 中用 veth 测试时需要
+  sysctl -w net.ipv4.ip_forward=1 ，写入的路由可以用 ip route show table 254 proto rip 查看。
+*/
+
+#ifndef KERNEL_TABLE
+#define KERNEL_TABLE 0 // 0 表示不写入内核，254 是 main 表
+#endif
+
+#define KFIB_BATCH_BYTES 65536 // 一次 sendmsg 的消息总长度上限
+
+uint32_t kernel_table = KERNEL_TABLE;
+int kfib_fd = -1;
+uint32_t kfib_seq = 0;
+
+// 前缀的网关，按地址排序以便比较，size 为 0 表示不应在内核中
+PrefixHash<NextHopGroup> kernel_routes; // 内核中已有的路由
+PrefixHash<NextHopGroup> kernel_pending; // 等待 kfib_flush 的路由
+
+struct KfibRequest {
+  uint32_t seq;
+  uint32_t addr, len;
+  bool insert;
+};
+vector<uint8_t> kfib_batch;
+vector<KfibRequest> kfib_requests; // kfib_batch 中的消息，用于找出失败的请求
+
+extern const NextHopGroup *nhg_get(uint32_t id);
+
+static bool same_gateways(const NextHopGroup &a, const NextHopGroup &b) {
+  return a.size == b.size && memcmp(a.nexthop, b.nexthop, sizeof(uint32_t) * a.size) == 0;
+}
+
+static void sort_gateways(NextHopGroup *group) {
+  std::sort(group->nexthop, group->nexthop + group->size);
+  memset(group->if_index, 0, sizeof(group->if_index));
+}
+
+// 表项应当写入内核的网关，直连路由为空
+static NextHopGroup gateways_of(const RoutingTableEntry &entry) {
+  NextHopGroup res;
+  memset(&res, 0, sizeof(res));
+  if (entry.group != 0) {
+    const NextHopGroup *group = nhg_get(entry.group);
+    res.size = group->size;
+    memcpy(res.nexthop, group->nexthop, sizeof(res.nexthop));
+  } else {
+    res.size = 1;
+    res.nexthop[0] = entry.nexthop;
+  }
+  for (uint32_t i = 0; i < res.size; i++) {
+    if (res.nexthop[i] == 0) {
+      res.size = 0;
+    }
+  }
+  sort_gateways(&res);
+  return res;
+}
+
+static void put_attr(uint16_t type, const void *data, uint16_t len) {
+  struct rtattr rta;
+  rta.rta_type = type;
+  rta.rta_len = RTA_LENGTH(len);
+  size_t pos = kfib_batch.size();
+  kfib_batch.resize(pos + RTA_SPACE(len));
+  memcpy(&kfib_batch[pos], &rta, sizeof(rta));
+  memcpy(&kfib_batch[pos + RTA_LENGTH(0)], data, len);
+}
+
+// 在 kfib_batch 末尾拼一条 RTM_NEWROUTE/RTM_DELROUTE ，gateways 为空时删除
+static void put_route(uint32_t addr, uint32_t len, const NextHopGroup &gateways) {
+  size_t begin = kfib_batch.size();
+  kfib_batch.resize(begin + NLMSG_SPACE(sizeof(struct rtmsg)));
+  struct nlmsghdr *nlh = (struct nlmsghdr *)&kfib_batch[begin];
+  nlh->nlmsg_type = gateways.size > 0 ? RTM_NEWROUTE : RTM_DELROUTE;
+  nlh->nlmsg_flags = NLM_F_REQUEST | (gateways.size > 0 ? NLM_F_CREATE | NLM_F_REPLACE : 0);
+  nlh->nlmsg_seq = ++kfib_seq;
+  nlh->nlmsg_pid = 0;
+  struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(nlh);
+  memset(rtm, 0, sizeof(*rtm));
+  rtm->rtm_family = AF_INET;
+  rtm->rtm_dst_len = len;
+  rtm->rtm_table = kernel_table < 256 ? kernel_table : RT_TABLE_UNSPEC;
+  rtm->rtm_protocol = RTPROT_RIP;
+  rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+  rtm->rtm_type = RTN_UNICAST;
+  put_attr(RTA_TABLE, &kernel_table, sizeof(uint32_t));
+  if (len > 0) {
+    put_attr(RTA_DST, &addr, sizeof(uint32_t));
+  }
+  if (gateways.size == 1) {
+    put_attr(RTA_GATEWAY, &gateways.nexthop[0], sizeof(uint32_t));
+  } else if (gateways.size > 1) {
+    // 每条路径是一个 rtnexthop 加上它的 RTA_GATEWAY ，出端口由内核决定
+    uint8_t paths[ECMP_MAX_PATHS * (RTNH_SPACE(0) + RTA_SPACE(sizeof(uint32_t)))];
+    uint16_t size = 0;
+    for (uint32_t i = 0; i < gateways.size; i++) {
+      struct rtnexthop rtnh;
+      memset(&rtnh, 0, sizeof(rtnh));
+      rtnh.rtnh_len = RTNH_LENGTH(RTA_SPACE(sizeof(uint32_t)));
+      struct rtattr rta;
+      rta.rta_type = RTA_GATEWAY;
+      rta.rta_len = RTA_LENGTH(sizeof(uint32_t));
+      memcpy(&paths[size], &rtnh, sizeof(rtnh));
+      memcpy(&paths[size + RTNH_LENGTH(0)], &rta, sizeof(rta));
+      memcpy(&paths[size + RTNH_LENGTH(0) + RTA_LENGTH(0)], &gateways.nexthop[i], sizeof(uint32_t));
+      size += RTNH_ALIGN(rtnh.rtnh_len);
+    }
+    put_attr(RTA_MULTIPATH, paths, size);
+  }
+  nlh = (struct nlmsghdr *)&kfib_batch[begin];
+  nlh->nlmsg_len = kfib_batch.size() - begin;
+  KfibRequest request = {kfib_seq, addr, len, gateways.size > 0};
+  kfib_requests.push_back(request);
+}
+
+// 发送 kfib_batch 中的消息，读出失败的回复，返回失败的个数
+static uint32_t send_batch() {
+  if (kfib_batch.empty()) {
+    return 0;
+  }
+  struct sockaddr_nl kernel;
+  memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+  uint32_t failed = 0;
+  if (sendto(kfib_fd, kfib_batch.data(), kfib_batch.size(), 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0) {
+    printf("Kernel FIB: sendto failed with %s\n", strerror(errno));
+    // 这些前缀在内核中的状态未知，下次变化时重新写入
+    failed = kfib_requests.size();
+    for (uint32_t i = 0; i < kfib_requests.size(); i++) {
+      kernel_routes.erase(kfib_requests[i].addr, kfib_requests[i].len);
+    }
+  }
+  uint8_t buffer[8192];
+  ssize_t n;
+  while ((n = recv(kfib_fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, (uint32_t)n); nlh = NLMSG_NEXT(nlh, n)) {
+      if (nlh->nlmsg_type != NLMSG_ERROR) {
+        continue;
+      }
+      struct nlmsgerr *err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+      if (err->error == 0) {
+        continue;
+      }
+      // 请求按 seq 递增排列
+      KfibRequest key = {err->msg.nlmsg_seq, 0, 0, false};
+      vector<KfibRequest>::iterator it = std::lower_bound(kfib_requests.begin(), kfib_requests.end(), key,
+          [](const KfibRequest &a, const KfibRequest &b) { return a.seq < b.seq; });
+      if (it == kfib_requests.end() || it->seq != key.seq) {
+        continue;
+      }
+      if (!it->insert && err->error == -ESRCH) {
+        // 已经不在内核中了
+        continue;
+      }
+      failed++;
+      printf("Kernel FIB: %s %s/%u failed with %s\n", it->insert ? "replace" : "delete", ip_string(it->addr).c_str(), it->len, strerror(-err->error));
+      if (it->insert) {
+        kernel_routes.erase(it->addr, it->len);
+      }
+    }
+  }
+  kfib_batch.clear();
+  kfib_requests.clear();
+  return failed;
+}
+
+// 解析 RTA_GATEWAY 或 RTA_MULTIPATH 中的网关
+static void parse_gateways(struct rtmsg *rtm, int attrlen, uint32_t *table, uint32_t *addr, NextHopGroup *gateways) {
+  for (struct rtattr *rta = RTM_RTA(rtm); RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+    if (rta->rta_type == RTA_TABLE) {
+      memcpy(table, RTA_DATA(rta), sizeof(uint32_t));
+    } else if (rta->rta_type == RTA_DST) {
+      memcpy(addr, RTA_DATA(rta), sizeof(uint32_t));
+    } else if (rta->rta_type == RTA_GATEWAY && gateways->size < ECMP_MAX_PATHS) {
+      memcpy(&gateways->nexthop[gateways->size++], RTA_DATA(rta), sizeof(uint32_t));
+    } else if (rta->rta_type == RTA_MULTIPATH) {
+      struct rtnexthop *rtnh = (struct rtnexthop *)RTA_DATA(rta);
+      int len = RTA_PAYLOAD(rta);
+      while (RTNH_OK(rtnh, len) && gateways->size < ECMP_MAX_PATHS) {
+        int nhlen = rtnh->rtnh_len - RTNH_LENGTH(0);
+        for (struct rtattr *a = RTNH_DATA(rtnh); RTA_OK(a, nhlen); a = RTA_NEXT(a, nhlen)) {
+          if (a->rta_type == RTA_GATEWAY) {
+            memcpy(&gateways->nexthop[gateways->size++], RTA_DATA(a), sizeof(uint32_t));
+          }
+        }
+        len -= RTNH_ALIGN(rtnh->rtnh_len);
+        rtnh = RTNH_NEXT(rtnh);
+      }
+    }
+  }
+}
+
+// 读出内核表中由 RIP 写入的路由
+static bool dump_routes() {
+  struct {
+    struct nlmsghdr nlh;
+    struct rtmsg rtm;
+  } request;
+  memset(&request, 0, sizeof(request));
+  request.nlh.nlmsg_len = sizeof(request);
+  request.nlh.nlmsg_type = RTM_GETROUTE;
+  request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.nlh.nlmsg_seq = ++kfib_seq;
+  request.rtm.rtm_family = AF_INET;
+  if (send(kfib_fd, &request, sizeof(request), 0) < 0) {
+    return false;
+  }
+  static uint8_t buffer[32768];
+  while (true) {
+    ssize_t n = recv(kfib_fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      return false;
+    }
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, (uint32_t)n); nlh = NLMSG_NEXT(nlh, n)) {
+      if (nlh->nlmsg_type == NLMSG_DONE) {
+        return true;
+      } else if (nlh->nlmsg_type == NLMSG_ERROR) {
+        return false;
+      } else if (nlh->nlmsg_type != RTM_NEWROUTE) {
+        continue;
+      }
+      struct rtmsg *rtm = (struct rtmsg *)NLMSG_DATA(nlh);
+      if (rtm->rtm_protocol != RTPROT_RIP || rtm->rtm_type != RTN_UNICAST) {
+        continue;
+      }
+      uint32_t table = rtm->rtm_table, addr = 0;
+      NextHopGroup gateways;
+      memset(&gateways, 0, sizeof(gateways));
+      parse_gateways(rtm, RTM_PAYLOAD(nlh), &table, &addr, &gateways);
+      if (table == kernel_table) {
+        sort_gateways(&gateways);
+        kernel_routes.insert(addr, rtm->rtm_dst_len, gateways);
+      }
+    }
+  }
+}
+
+/**
+ * @brief 打开 rtnetlink 并读出内核表的现状，KERNEL_TABLE 为 0 时什么也不做
+ * @return 是否启用了内核转发
+ */
+bool kfib_open() {
+  if (kernel_table == 0) {
+    return false;
+  }
+  kfib_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (kfib_fd < 0) {
+    printf("Kernel FIB: rtnetlink unavailable: %s\n", strerror(errno));
+    return false;
+  }
+  // 一批消息全部失败时回复也放得下
+  int size = 4 * KFIB_BATCH_BYTES;
+  setsockopt(kfib_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  if (!dump_routes()) {
+    printf("Kernel FIB: failed to read table %u\n", kernel_table);
+    close(kfib_fd);
+    kfib_fd = -1;
+    return false;
+  }
+  printf("Kernel FIB: table %u has %u RIP routes\n", kernel_table, kernel_routes.size());
+  return true;
+}
+
+/**
+ * @brief 暂存路由表的一次变化，与 update 的参数相同
+ */
+void kfib_update(bool insert, const RoutingTableEntry &entry) {
+  if (kfib_fd < 0) {
+    return;
+  }
+  NextHopGroup gateways;
+  memset(&gateways, 0, sizeof(gateways));
+  if (insert) {
+    gateways = gateways_of(entry);
+  }
+  kernel_pending.insert(entry.addr, entry.len, gateways);
+}
+
+/**
+ * @brief 删除内核中有、但没有暂存的路由，与 kfib_flush 一起在整张表重建后使用
+ */
+void kfib_prune() {
+  NextHopGroup none;
+  memset(&none, 0, sizeof(none));
+  kernel_routes.for_each([&](uint32_t addr, uint32_t len, const NextHopGroup &gateways) {
+    if (kernel_pending.find(addr, len) == NULL) {
+      kernel_pending.insert(addr, len, none);
+    }
+  });
+}
+
+/**
+ * @brief 把暂存的变化中与内核不同的部分批量写入内核
+ * @return 写入的路由个数
+ */
+uint32_t kfib_flush() {
+  if (kfib_fd < 0 || kernel_pending.size() == 0) {
+    return 0;
+  }
+  uint32_t written = 0;
+  kernel_pending.for_each([&](uint32_t addr, uint32_t len, const NextHopGroup &gateways) {
+    NextHopGroup *known = kernel_routes.find(addr, len);
+    if (gateways.size == 0 ? known == NULL : known != NULL && same_gateways(*known, gateways)) {
+      return;
+    }
+    put_route(addr, len, gateways);
+    if (gateways.size == 0) {
+      kernel_routes.erase(addr, len);
+    } else {
+      kernel_routes.insert(addr, len, gateways);
+    }
+    written++;
+    if (kfib_batch.size() >= KFIB_BATCH_BYTES) {
+      send_batch();
+    }
+  });
+  send_batch();
+  kernel_pending = PrefixHash<NextHopGroup>();
+  return written;
+}
@@ -3,6 +3,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "rip.h"
+#include "rib.h"
+#include "router_hal.h"
+#include "prefix_hash.h"
+#include "routing_table.h"
+#include "fib_compress.h"
 
 
 /*
@@ -19,19 +24,48 @@
   保证 addr 仅最低 len 位可能出现非零。
   当 nexthop 为零时这是一条直连路由。
   你可以在全局变量中把路由表以一定的数据结构格式保存下来。
+
+  路由表的数据结构见 Homework/common/routing_table.h 。
+  table 保存完整的路由，供控制面查询和通告；转发用的 fib 是 table 经 ORTC 压缩后的
+  等价表（见 Homework/common/fib_compress.h），前缀少得多，数据结构编译时用 ENGINE 选择。
+  两者的最长前缀匹配结果（出端口、下一跳、下一跳组）完全相同，可以用 fib_verify 检查。
 */
 
-struct RoutingList {
-  RoutingTableEntry entry;
-  RoutingList * next = NULL;
-  RoutingList() {
-  }
-  RoutingList(RoutingTableEntry e) {
-    entry = e;
+RoutingTable<PatriciaEngine<RoutingTableEntry> > table;
+
+// 转发动作相同：metric 不影响转发，主路径失效时的备份路径也要相同
+struct FibSame {
+  bool operator()(const RoutingTableEntry &a, const RoutingTableEntry &b) const {
+    return a.if_index == b.if_index && a.nexthop == b.nexthop && a.group == b.group && a.backup == b.backup;
   }
-} first;
+};
+
+FibCompressor<RoutingTableEntry, FibSame> compressor;
+RoutingTable<ROUTING_ENGINE<RoutingTableEntry> > fib; // 在下一次转发查询之前压缩
+
+extern void xdp_route(bool insert, const RoutingTableEntry &entry);
+extern void shm_fib_route(bool insert, const RoutingTableEntry &entry);
+extern void shm_fib_publish();
+
+// XDP 快速路径和共享内存中的路由表与 fib 相同，见 xdp.cpp 和 shm_fib.cpp
+static void fib_flush() {
+  compressor.flush([](bool insert, const RoutingTableEntry &entry) {
+    if (insert) {
+      fib.insert(entry);
+    } else {
+      fib.erase(entry.addr, entry.len);
+    }
+    xdp_route(insert, entry);
+    shm_fib_route(insert, entry);
+  });
+}
 
-int entry_num = 0;
+extern void advert_update(bool insert, const RoutingTableEntry &entry);
+extern void advert_clear();
+extern void advert_changes_clear(uint32_t if_index);
+extern void kfib_update(bool insert, const RoutingTableEntry &entry);
+extern void kfib_prune();
+extern uint32_t kfib_flush();
 
 /**
  * @brief 插入/删除一条路由表表项
@@ -42,37 +76,103 @@ int entry_num = 0;
  * 删除时按照 addr 和 len 匹配。
  */
 void update(bool insert, RoutingTableEntry entry) {
-  // TODO:
-  
   #ifdef DEBUG_OUTPUT
   printf("update\n");
   entry.print();
   #endif
-  RoutingList * before;
-  RoutingList * now = &first;
-  RoutingList * next = first.next;
-  while (next != NULL) {
-    before = now;
-    now = next;
-    next = now->next;
-    if (now->entry.addr == entry.addr && now->entry.len == entry.len){
-      if (insert) {
-        now->entry.if_index = entry.if_index;
-        now->entry.nexthop = entry.nexthop;
-        entry_num += 1;
-      }
-      else {
-        before->next = next;
-        delete now;
-        entry_num -= 1;
-      }
-      return;
+  if (insert) {
+    table.insert(entry);
+    compressor.insert(entry);
+  } else {
+    table.erase(entry.addr, entry.len);
+    compressor.erase(entry.addr, entry.len);
+  }
+  kfib_update(insert, entry);
+  advert_update(insert, entry);
+}
+
+/*
+  FIB 的批量更新：一段时间内 RIB 输出的增量先用 fib_stage 暂存，同一个前缀只保留最后一次，
+  再由 fib_commit 一次性应用到路由表和通告（以及内核路由表和共享内存，见 kernel_fib.cpp 和 shm_fib.cpp）。邻居一次发来整张表时，几百个包的增量
+  合并成一批，同一个前缀在窗口内反复变化也只改一次路由表。
+*/
+vector<FibDelta> staged;
+PrefixHash<uint32_t> staged_index; // (addr, len) -> staged 中的下标
+
+/**
+ * @brief 暂存 RIB 输出的增量，后来的增量覆盖同一前缀之前的
+ */
+void fib_stage(const vector<FibDelta> &deltas) {
+  for (uint32_t i = 0; i < deltas.size(); i++) {
+    const RoutingTableEntry &entry = deltas[i].entry;
+    uint32_t *pos = staged_index.find(entry.addr, entry.len);
+    if (pos != NULL) {
+      staged[*pos] = deltas[i];
+    } else {
+      staged_index.insert(entry.addr, entry.len, staged.size());
+      staged.push_back(deltas[i]);
     }
   }
-  if (insert) {
-    RoutingList * newRouting = new RoutingList(entry);
-    now->next = newRouting;
-    entry_num += 1;
+}
+
+/**
+ * @brief 暂存的增量个数
+ */
+uint32_t fib_staged() {
+  return staged.size();
+}
+
+/**
+ * @brief 应用所有暂存的增量
+ * @return 应用的增量个数
+ */
+uint32_t fib_commit() {
+  uint32_t n = staged.size();
+  for (uint32_t i = 0; i < n; i++) {
+    update(staged[i].insert, staged[i].entry);
+    staged_index.erase(staged[i].entry.addr, staged[i].entry.len);
+  }
+  fib_flush();
+  shm_fib_publish();
+  kfib_flush();
+  staged.clear();
+  return n;
+}
+
+/**
+ * @brief 把 RIB 输出的增量连同暂存的增量立即应用到路由表
+ * @param deltas 增量，按产生的顺序应用
+ */
+void fib_apply(const vector<FibDelta> &deltas) {
+  fib_stage(deltas);
+  fib_commit();
+}
+
+/**
+ * @brief 批量建立路由表，替换掉原有的全部表项
+ * @param entries 表项数组，可以无序，也可以有 addr 和 len 都相同的重复项
+ * @param n 表项个数
+ *
+ * 先排序去重（重复项保留数组中靠后的一项，与逐条 update 的替换语义一致），
+ * 再一次性建立查询结构，而不是逐条插入。数组会被原地重排。
+ */
+void build(RoutingTableEntry *entries, uint32_t n) {
+  table.build(entries, n);
+  compressor.clear();
+  fib.clear();
+  advert_clear();
+  table.for_each([](const RoutingTableEntry &entry) {
+    compressor.insert(entry);
+    kfib_update(true, entry);
+    advert_update(true, entry);
+  });
+  fib_flush();
+  shm_fib_publish();
+  kfib_prune();
+  kfib_flush();
+  // 重新建表不算路由变化，由下一次定时更新完整地通告
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    advert_changes_clear(i);
   }
 }
 
@@ -84,74 +184,96 @@ void update(bool insert, RoutingTableEntry entry) {
  * @return 查到则返回 true ，没查到则返回 false
  */
 bool query(uint32_t addr, uint32_t *nexthop, uint32_t *if_index, uint32_t *metric) {
-  // TODO:
-  
-  bool res = false;
-  RoutingList * now = &first;
-  RoutingList * next = first.next;
-  uint32_t max_len = 0;
-  while (next != NULL) {
-    now = next;
-    next = now->next;
-    if (now->entry.len > max_len) {
-      uint32_t mask = (uint32_t)(((uint64_t)(0x0000000000000001) << now->entry.len) - 1);
-      if ((addr & mask) == (now->entry.addr & mask)) {
-        *nexthop = now->entry.nexthop;
-        *if_index = now->entry.if_index;
-        *metric = now->entry.metric;
-        max_len = now->entry.len;
-        res = true;
-      }
-    }
+  const RoutingTableEntry *entry = table.query(addr);
+  if (entry == NULL) {
+    return false;
   }
-  return res;
+  *nexthop = entry->nexthop;
+  *if_index = entry->if_index;
+  *metric = entry->metric;
+  return true;
 }
 
-void get_packet(vector<RipPacket> * res, uint32_t if_index) {
-  
-  RoutingList * now = &first;
-  RoutingList * next = first.next;
-  uint32_t l = 0;
-  RipPacket temp_p;
-  while (next != NULL) {
-    now = next;
-    next = now->next;
-    if (now->entry.if_index == if_index){
-      continue;
-    }
-    temp_p.command = 2;
-    temp_p.entries[l].addr = now->entry.addr;
-    temp_p.entries[l].mask = (((uint64_t)1 << now->entry.len) - 1);
-    temp_p.entries[l].nexthop = now->entry.nexthop;
-    temp_p.entries[l].metric = now->entry.metric;
-    l++;
-    if (l >= 24) {
-      temp_p.numEntries = l;
-      res->push_back(temp_p);
-      l = 0;
-    }
+extern void nhg_select(uint32_t id, uint32_t hash, uint32_t *nexthop, uint32_t *if_index);
+extern bool backup_select(uint32_t id, uint32_t *nexthop, uint32_t *if_index);
+
+/**
+ * @brief 转发用的查询，按照最长前缀匹配原则，命中等价多路径表项时按流哈希选择其中一条，
+ *        主路径失效时选择备份路径
+ * @param addr 需要查询的目标地址，大端序
+ * @param hash 报文的流哈希，见 flow_hash
+ * @param nexthop 如果查询到目标，把选中路径的 nexthop 写入
+ * @param if_index 如果查询到目标，把选中路径的 if_index 写入
+ * @return 查到则返回 true ，没查到则返回 false
+ */
+bool query_flow(uint32_t addr, uint32_t hash, uint32_t *nexthop, uint32_t *if_index) {
+  if (compressor.pending()) {
+    fib_flush();
+  }
+  const RoutingTableEntry *entry = fib.query(addr);
+  if (entry == NULL) {
+    return false;
   }
-  if (l < 24) {
-    temp_p.numEntries = l;
-    res->push_back(temp_p);
+  if (entry->group != 0) {
+    nhg_select(entry->group, hash, nexthop, if_index);
+  } else if (entry->backup == 0 || !backup_select(entry->backup, nexthop, if_index)) {
+    *nexthop = entry->nexthop;
+    *if_index = entry->if_index;
   }
+  return true;
 }
 
+/**
+ * @brief 压缩后的转发表的前缀个数
+ */
+uint32_t fib_prefixes() {
+  fib_flush();
+  return fib.size();
+}
+
+/**
+ * @brief 差分检查：压缩后的转发表与完整路由表的最长前缀匹配结果是否处处相同
+ *
+ * 最长前缀匹配的结果只在某个前缀的起点或终点之后一个地址处变化，
+ * 所以只需比较两张表所有前缀的这些端点，就覆盖了整个地址空间。
+ */
+bool fib_verify() {
+  fib_flush();
+  vector<uint32_t> points(1, 0);
+  auto add = [&](const RoutingTableEntry &entry) {
+    uint32_t key = rt_key(entry.addr);
+    points.push_back(key);
+    uint64_t end = (uint64_t)key + ((uint64_t)1 << (32 - entry.len));
+    if (end <= 0xFFFFFFFFULL) {
+      points.push_back((uint32_t)end);
+    }
+  };
+  table.for_each(add);
+  fib.for_each(add);
+  FibSame same;
+  for (uint32_t i = 0; i < points.size(); i++) {
+    uint32_t addr = rt_key(points[i]);
+    const RoutingTableEntry *a = table.query(addr);
+    const RoutingTableEntry *b = fib.query(addr);
+    if ((a == NULL) != (b == NULL) || (a != NULL && !same(*a, *b))) {
+      printf("FIB mismatch at %s\n", ip_string(addr).c_str());
+      return false;
+    }
+  }
+  return true;
+}
 
 void print_all_entry(){
-  if (entry_num > 25) {
-    RoutingList * now = &first;
-    RoutingList * next = first.next;
+  if (table.size() > 25) {
     uint32_t l = 0;
-    while (next != NULL) {
-      now = next;
-      next = now->next;
+    table.for_each([&](const RoutingTableEntry &entry) {
       printf("the %d entry:\n", l);
-      now->entry.print();
+      RoutingTableEntry e = entry;
+      e.print();
       l++;
-    }
+    });
   }
   else {
-    printf("total %d entries\n", entry_num);
+    printf("total %d entries\n", table.size());
   }
-}
\ No newline at end of file
+}
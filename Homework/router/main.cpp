@@ -1,6 +1,9 @@
+#include "rib.h"
 #include "rip.h"
 #include "router.h"
 #include "router_hal.h"
+#include "timer.h"
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,22 +17,74 @@ typedef uint32_t in_addr_t;
 extern bool validateIPChecksum(uint8_t *packet, size_t len);
 extern void update(bool insert, RoutingTableEntry entry);
 extern bool query(uint32_t addr, uint32_t *nexthop, uint32_t *if_index, uint32_t *metric);
-extern bool forward(uint8_t *packet, size_t len);
-extern bool disassemble(const uint8_t *packet, uint32_t len, RipPacket *output);
+extern bool forward_fast(uint8_t *packet, size_t len);
+extern uint32_t flow_hash(const uint8_t *packet, size_t len);
+extern bool query_flow(uint32_t addr, uint32_t hash, uint32_t *nexthop, uint32_t *if_index);
+extern bool parse_rip_header(const uint8_t *packet, uint32_t len, RipView *view);
+extern bool rip_entries_valid(const RipView &view);
 extern uint32_t assemble(const RipPacket *rip, uint8_t *buffer);
-extern void get_packet(vector<RipPacket> * res, uint32_t if_index);
+extern uint32_t advert_chunks(uint32_t if_index);
+extern void advert_packet(uint32_t if_index, uint32_t chunk, RipPacket *packet);
 extern uint32_t assembleUDP(uint8_t *buffer, uint32_t riplen);
 extern uint32_t assembleIP(uint8_t *buffer, uint32_t udplen, uint32_t src, uint32_t dst);
+extern const uint8_t *advert_wire(uint32_t if_index, uint32_t chunk, uint32_t src, uint32_t dst, uint32_t *len);
+extern void rewriteIPDst(uint8_t *buffer, uint32_t dst);
+extern uint32_t advert_changed_chunks(uint32_t if_index);
+extern void advert_changed_packet(uint32_t if_index, uint32_t chunk, RipPacket *packet);
+extern void advert_changes_clear(uint32_t if_index);
+extern uint32_t advert_prefixes(uint32_t if_index, uint32_t *count);
+extern uint32_t fib_prefixes();
 extern void print_all_entry();
+extern void build(RoutingTableEntry *entries, uint32_t n);
+extern void fib_stage(const vector<FibDelta> &deltas);
+extern uint32_t fib_staged();
+extern uint32_t fib_commit();
+extern bool rib_update(uint32_t addr, uint32_t len, RibCandidate cand, vector<FibDelta> *deltas);
+extern void rib_best_routes(vector<RoutingTableEntry> *res);
+extern int load_static_routes(const char *path, const uint32_t *if_addrs, uint32_t default_if, vector<RoutingTableEntry> *res);
+extern bool rib_expire(uint32_t addr, uint32_t len, uint32_t nexthop, uint32_t if_index, uint64_t now, vector<FibDelta> *deltas);
+extern void rib_holddown_end(uint32_t addr, uint32_t len);
+extern void advert_gc(uint32_t addr, uint32_t len);
+extern uint64_t fp_compute(uint32_t src_addr, uint32_t if_index, const RipView &rip);
+extern uint32_t fp_lookup(uint64_t fingerprint);
+extern void fp_refresh(uint32_t id, uint64_t time);
+extern uint32_t fp_create(uint64_t fingerprint, uint32_t src_addr, uint32_t if_index, uint64_t time);
+extern void fp_commit(uint32_t id, uint32_t expected, bool withdrawals);
+extern bool rib_withdraw(uint32_t addr, uint32_t len, uint32_t nexthop, uint32_t if_index, vector<FibDelta> *deltas);
+extern uint32_t rib_withdraw_neighbor(uint32_t nexthop, uint32_t if_index, vector<FibDelta> *deltas);
+extern uint32_t rib_withdraw_port(uint32_t if_index, vector<FibDelta> *deltas);
+extern void adjacency_set_port_down(uint32_t if_index, bool down);
+extern void bfd_discover(uint32_t addr, uint32_t if_index, uint64_t time);
+extern bool bfd_blocked(uint32_t addr, uint32_t if_index);
+extern bool bfd_receive(uint32_t src_addr, uint32_t if_index, const uint8_t *packet, uint32_t len, uint64_t time, bool *down);
+extern uint32_t bfd_send(uint32_t addr, uint32_t if_index, uint32_t src, uint8_t *buffer, uint64_t time);
+extern void bfd_defer(uint32_t addr, uint32_t if_index, uint64_t time);
+extern bool bfd_expire(uint32_t addr, uint32_t if_index, uint64_t time);
+extern void timer_start(uint64_t now);
+extern uint64_t timer_now();
+extern uint32_t timer_add(uint64_t expire, RouterTimer timer);
+extern void timer_modify(uint32_t id, uint64_t expire);
+extern void timer_cancel(uint32_t id);
+extern void timer_advance(uint64_t now, void (*handler)(const RouterTimer &timer));
+extern uint64_t timer_next(uint64_t limit);
+extern bool kfib_open();
+extern uint32_t xdp_open(const in_addr_t *if_addrs);
+extern void xdp_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac);
+extern void xdp_neighbor_down(uint32_t addr, uint32_t if_index);
+extern void xdp_port_down(uint32_t if_index);
+extern void xdp_neighbor_check(int (*arp)(int if_index, in_addr_t ip, macaddr_t o_mac));
+extern bool shm_fib_open(const in_addr_t *if_addrs);
+extern void shm_fib_ports(const in_addr_t *if_addrs);
+extern void shm_fib_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac);
+extern void snapshot_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac);
+extern bool snapshot_neighbor_mac(uint32_t addr, uint32_t if_index, uint8_t *mac);
+extern void snapshot_neighbor_prune();
+extern uint32_t snapshot_load(uint64_t now, vector<FibDelta> *deltas);
+extern bool snapshot_save();
 
 uint32_t mask_len(uint32_t mask) {
-  //printf("mask: %08x", mask);
-  for (int i = 0; i < 32; i++){
-    if ((mask & (1 << i)) == 0){
-      return i;
-    }
-  }
-  return 32;
+  // mask is big endian and contiguous (checked by rip_entries_valid), so count the ones
+  return __builtin_popcount(mask);
 }
 
 char ip_buffer[20];
@@ -52,16 +107,302 @@ uint8_t output[2048];
 // 3: 10.0.3.1
 // 你可以按需进行修改，注意端序
 in_addr_t addrs[N_IFACE_ON_BOARD] = {0x0103A8C0, 0x0101A8C0, 0x0102000a, 0x0103000a};
+// link state reported by HAL_SetInterfaceCallback, assumed up at startup
+bool port_up[N_IFACE_ON_BOARD] = {true, true, true, true};
+
+// a port with a dead link or without an address has no direct route and sends no RIP
+bool port_ready(uint32_t if_index) {
+  return port_up[if_index] && addrs[if_index] != 0;
+}
 
 
 in_addr_t multicast_addr = (9 << 24) + 224;
 
+// triggered updates, ref. RFC2453 3.10.1:
+// changes within TRIGGER_COALESCE ms are sent together, and after a triggered
+// update the next one waits a random 1-5 s, changes meanwhile accumulate;
+// a lost route is urgent: it goes out at once, ignoring both, so that neighbors
+// drop the dead path before they can pass it around the network
+#define TRIGGER_COALESCE 50
+uint32_t trigger_timer = 0; // 0 if no triggered update is pending
+uint64_t trigger_holdoff = 0; // no triggered update before this
+
+void schedule_triggered_update(uint64_t time, bool urgent) {
+  uint64_t expire = time;
+  if (!urgent) {
+    expire = time + TRIGGER_COALESCE > trigger_holdoff ? time + TRIGGER_COALESCE : trigger_holdoff;
+  }
+  RouterTimer timer = {.kind = TIMER_TRIGGERED_UPDATE};
+  if (trigger_timer == 0) {
+    trigger_timer = timer_add(expire, timer);
+  } else if (urgent) {
+    timer_modify(trigger_timer, expire);
+  }
+}
+
+bool has_withdrawal(const vector<FibDelta> &deltas) {
+  for (uint32_t i = 0; i < deltas.size(); i++) {
+    if (!deltas[i].insert) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// send the routes changed since the last update to every interface
+void send_triggered_update(uint64_t time) {
+  RipPacket rip;
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    if (!port_ready(i)) {
+      advert_changes_clear(i);
+      continue;
+    }
+    macaddr_t multicast_mac;
+    HAL_ArpGetMacAddress(i, multicast_addr, multicast_mac);
+    for (uint32_t j = 0; j < advert_changed_chunks(i); j++) {
+      advert_changed_packet(i, j, &rip);
+      uint32_t riplen = assemble(&rip, output);
+      uint32_t udplen = assembleUDP(output, riplen);
+      uint32_t iplen  = assembleIP(output, udplen, addrs[i], multicast_addr);
+      HAL_SendIPPacket(i, output, iplen, multicast_mac);
+      #ifdef DEBUG_OUTPUT
+      printf("Update send packet from %08x(%s) to %08x(%s), port %d, len is %d, %d entries.\n", addrs[i], ip_string(addrs[i]).c_str(), multicast_addr, ip_string(multicast_addr).c_str(), i, iplen, rip.numEntries);
+      #endif
+    }
+    advert_changes_clear(i);
+  }
+  trigger_holdoff = time + 1000 + rand() % 4000;
+}
+
+// periodic updates, ref. RFC2453 3.8
+// every interface runs its own jittered UPDATE_INTERVAL cycle, started staggered, and
+// a cycle is sent UPDATE_BURST packets per UPDATE_PACE ms so forwarding goes on in between
+uint32_t update_cursor[N_IFACE_ON_BOARD]; // next chunk of the cycle in progress
+uint32_t pace_timer[N_IFACE_ON_BOARD]; // 0 if the cycle is complete
+
+void schedule_update(uint32_t if_index, uint64_t time) {
+  RouterTimer timer = {.kind = TIMER_UPDATE, .if_index = if_index};
+  timer_add(time + UPDATE_INTERVAL - UPDATE_JITTER + rand() % (2 * UPDATE_JITTER + 1), timer);
+}
+
+// send the next batch of the complete routing table to one interface
+// multicast MAC for 224.0.0.9 is 01:00:5e:00:00:09
+// packets are cached per interface and only re-assembled after a route change
+void send_update_batch(uint32_t if_index, uint64_t time) {
+  if (!port_ready(if_index)) {
+    return;
+  }
+  macaddr_t multicast_mac;
+  HAL_ArpGetMacAddress(if_index, multicast_addr, multicast_mac);
+  uint32_t chunks = advert_chunks(if_index);
+  uint32_t &j = update_cursor[if_index];
+  for (uint32_t sent = 0; sent < UPDATE_BURST && j < chunks; sent++, j++) {
+    uint32_t iplen;
+    const uint8_t *cached = advert_wire(if_index, j, addrs[if_index], multicast_addr, &iplen);
+    HAL_SendIPPacket(if_index, (uint8_t *)cached, iplen, multicast_mac);
+    #ifdef DEBUG_OUTPUT
+    printf("Timer send packet from %08x(%s) to %08x(%s), port %d, len is %d, dst mac is %s.\n", addrs[if_index], ip_string(addrs[if_index]).c_str(), multicast_addr, ip_string(multicast_addr).c_str(), if_index, iplen, mac_string(multicast_mac).c_str());
+    #endif
+  }
+  if (j < chunks) {
+    RouterTimer timer = {.kind = TIMER_UPDATE_PACE, .if_index = if_index};
+    pace_timer[if_index] = timer_add(time + UPDATE_PACE, timer);
+  } else {
+    // the full table supersedes the pending triggered update on this interface
+    advert_changes_clear(if_index);
+  }
+}
+
+// start sending the full table to one interface, a cycle still being sent restarts
+void start_update_cycle(uint32_t if_index, uint64_t time) {
+  if (pace_timer[if_index] != 0) {
+    timer_cancel(pace_timer[if_index]);
+    pace_timer[if_index] = 0;
+  }
+  update_cursor[if_index] = 0;
+  send_update_batch(if_index, time);
+}
+
+// route changes from responses are staged and written to FIB in one batch
+// at most FIB_BATCH_WINDOW ms later, or as soon as FIB_BATCH_MAX are pending
+uint32_t commit_timer = 0; // 0 if nothing is staged
+
+void commit_routes() {
+  if (commit_timer != 0) {
+    timer_cancel(commit_timer);
+    commit_timer = 0;
+  }
+  fib_commit();
+}
+
+void stage_routes(const vector<FibDelta> &deltas, uint64_t time) {
+  fib_stage(deltas);
+  if (fib_staged() >= FIB_BATCH_MAX) {
+    commit_routes();
+  } else if (commit_timer == 0 && fib_staged() > 0) {
+    RouterTimer timer = {.kind = TIMER_FIB_COMMIT};
+    commit_timer = timer_add(time + FIB_BATCH_WINDOW, timer);
+  }
+}
+
+// a neighbor found dead by BFD: every route through it is withdrawn at once
+// instead of timing out one by one, ref. RFC5882 4.3
+void neighbor_down(uint32_t addr, uint32_t if_index, uint64_t time) {
+  vector<FibDelta> deltas;
+  uint32_t count = rib_withdraw_neighbor(addr, if_index, &deltas);
+  xdp_neighbor_down(addr, if_index);
+  snapshot_neighbor_prune();
+  printf("Neighbor %s on port %u is down, %u routes withdrawn\n", ip_string(addr).c_str(), if_index, count);
+  fib_stage(deltas);
+  commit_routes();
+  if (!deltas.empty()) {
+    schedule_triggered_update(time, has_withdrawal(deltas));
+  }
+}
+
+// a port went down, came up or changed its address, reported by the HAL:
+// its direct route follows at once, routes learned over a dead link are
+// dropped instead of timing out, and a port coming up gets the full table
+void port_changed(int if_index, int up, in_addr_t addr) {
+  uint64_t time = HAL_GetTicks();
+  vector<FibDelta> deltas;
+  bool was_ready = port_ready(if_index);
+  if (was_ready) {
+    rib_withdraw(addrs[if_index] & 0x00FFFFFF, 24, 0, if_index, &deltas);
+  }
+  if (!up) {
+    // backup paths and the other equal-cost members take over at once
+    adjacency_set_port_down(if_index, true);
+    xdp_port_down(if_index);
+    rib_withdraw_port(if_index, &deltas);
+    snapshot_neighbor_prune();
+  } else if (!port_up[if_index]) {
+    adjacency_set_port_down(if_index, false);
+  }
+  port_up[if_index] = up;
+  addrs[if_index] = addr;
+  shm_fib_ports(addrs);
+  if (port_ready(if_index)) {
+    RibCandidate cand = {
+      .nexthop = 0,
+      .if_index = (uint32_t)if_index,
+      .metric = 1,
+      .updated = 0
+    };
+    rib_update(addr & 0x00FFFFFF, 24, cand, &deltas);
+  }
+  printf("Port %d is %s, address %s, %u routes changed\n", if_index, up ? "up" : "down", ip_string(addr).c_str(), (uint32_t)deltas.size());
+  fib_stage(deltas);
+  commit_routes();
+  if (!deltas.empty()) {
+    schedule_triggered_update(time, has_withdrawal(deltas));
+  }
+  if (!was_ready && port_ready(if_index)) {
+    start_update_cycle(if_index, time);
+  }
+}
+
+// called by timer_advance for every expired timer, timer_now() is its deadline
+void on_timer(const RouterTimer &timer) {
+  uint64_t time = timer_now();
+  vector<FibDelta> deltas;
+  switch (timer.kind) {
+  case TIMER_UPDATE:
+    if (timer.if_index == 0) {
+      print_all_entry();
+      printf("30s Timer\n");
+    }
+    start_update_cycle(timer.if_index, time);
+    schedule_update(timer.if_index, time);
+    break;
+  case TIMER_UPDATE_PACE:
+    pace_timer[timer.if_index] = 0;
+    send_update_batch(timer.if_index, time);
+    break;
+  case TIMER_TRIGGERED_UPDATE:
+    trigger_timer = 0;
+    commit_routes();
+    send_triggered_update(time);
+    break;
+  case TIMER_ROUTE_TIMEOUT:
+    // no update from this neighbor for ROUTE_TIMEOUT
+    if (rib_expire(timer.addr, timer.len, timer.nexthop, timer.if_index, time, &deltas)) {
+      fib_stage(deltas);
+      commit_routes();
+      schedule_triggered_update(time, has_withdrawal(deltas));
+    }
+    snapshot_neighbor_prune();
+    break;
+  case TIMER_ROUTE_GC:
+    advert_gc(timer.addr, timer.len);
+    break;
+  case TIMER_HOLDDOWN:
+    rib_holddown_end(timer.addr, timer.len);
+    break;
+  case TIMER_FIB_COMMIT:
+    commit_timer = 0;
+    fib_commit();
+    break;
+  case TIMER_BFD_TX: {
+    // no source address while the port is down: keep the session's timer going
+    if (!port_ready(timer.if_index)) {
+      bfd_defer(timer.addr, timer.if_index, time);
+      break;
+    }
+    uint32_t iplen = bfd_send(timer.addr, timer.if_index, addrs[timer.if_index], output, time);
+    macaddr_t dest_mac;
+    if (HAL_ArpGetMacAddress(timer.if_index, timer.addr, dest_mac) == 0) {
+      HAL_SendIPPacket(timer.if_index, output, iplen, dest_mac);
+    }
+    break;
+  }
+  case TIMER_BFD_DETECT:
+    if (bfd_expire(timer.addr, timer.if_index, time)) {
+      neighbor_down(timer.addr, timer.if_index, time);
+    }
+    break;
+  case TIMER_SNAPSHOT: {
+    snapshot_save();
+    RouterTimer next = {.kind = TIMER_SNAPSHOT};
+    timer_add(time + SNAPSHOT_INTERVAL, next);
+    break;
+  }
+  case TIMER_XDP_NEIGHBOR: {
+    xdp_neighbor_check(HAL_ArpGetMacAddress);
+    RouterTimer next = {.kind = TIMER_XDP_NEIGHBOR};
+    timer_add(time + XDP_NEIGHBOR_CHECK, next);
+    break;
+  }
+  }
+}
+
+// set by SIGINT/SIGTERM, the main loop saves the snapshot and exits
+volatile sig_atomic_t stopping = 0;
+
+void on_signal(int sig) {
+  stopping = 1;
+}
+
 int main(int argc, char *argv[]) {
   // 0a.
   int res = HAL_Init(1, addrs);
   if (res < 0) {
     return res;
   }
+  // with KERNEL_TABLE set, best routes are written to that kernel table and
+  // the kernel forwards, see kernel_fib.cpp
+  bool offload = kfib_open();
+  // with SHM_FIB set, the FIB is published to shared memory and separate
+  // dataplane processes forward, see shm_fib.cpp and dataplane.cpp
+  bool shared = !offload && shm_fib_open(addrs);
+  // with XDP_FAST_PATH set, packets with a route and a resolved neighbor are
+  // forwarded by XDP before reaching us, see xdp.cpp
+  if (!offload && !shared) {
+    uint32_t ports = xdp_open(addrs);
+    if (ports > 0) {
+      printf("XDP fast path attached to %u ports\n", ports);
+    }
+  }
 
   // 0b. Add direct routes
   // For example:
@@ -69,6 +410,7 @@ int main(int argc, char *argv[]) {
   // 10.0.1.0/24 if 1
   // 10.0.2.0/24 if 2
   // 10.0.3.0/24 if 3
+  vector<RoutingTableEntry> initial;
   for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
     RoutingTableEntry entry = {
         .addr = addrs[i] & 0x00FFFFFF, // big endian
@@ -77,46 +419,79 @@ int main(int argc, char *argv[]) {
         .nexthop = 0,      // big endian, means direct
         .metric = 1
     };
-    update(true, entry);
+    initial.push_back(entry);
+  }
+
+  // 0c. Load static routes, e.g. ./boilerplate ../../Setup/conf-part9.conf [if_index]
+  // routes "via" an interface name go to if_index (default 0)
+  if (argc > 1) {
+    uint32_t default_if = argc > 2 ? atoi(argv[2]) : 0;
+    if (default_if >= N_IFACE_ON_BOARD) {
+      default_if = 0;
+    }
+    int count = load_static_routes(argv[1], addrs, default_if, &initial);
+    if (count < 0) {
+      printf("Failed to open %s\n", argv[1]);
+    } else {
+      printf("Loaded %d static routes from %s\n", count, argv[1]);
+    }
+  }
+  // every deadline lives in one timer wheel, restored routes already need theirs
+  timer_start(HAL_GetTicks());
+
+  // every local route is a RIB candidate as well, FIB is built from the best ones
+  vector<FibDelta> initial_deltas;
+  for (uint32_t i = 0; i < initial.size(); i++) {
+    RibCandidate cand = {
+      .nexthop = initial[i].nexthop,
+      .if_index = initial[i].if_index,
+      .metric = initial[i].metric,
+      .updated = 0
+    };
+    rib_update(initial[i].addr, initial[i].len, cand, &initial_deltas);
+  }
+  // with RIB_SNAPSHOT set, routes learned before a restart come back as stale
+  // candidates, see snapshot.cpp
+  snapshot_load(timer_now(), &initial_deltas);
+  initial.clear();
+  rib_best_routes(&initial);
+  build(initial.data(), initial.size());
+  printf("Forwarding table: %u routes compressed to %u prefixes\n", (uint32_t)initial.size(), fib_prefixes());
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    uint32_t count;
+    uint32_t prefixes = advert_prefixes(i, &count);
+    printf("Port %d advertises %u prefixes in %u packets (%u before summarization)\n", i, count, advert_chunks(i), prefixes);
   }
 
 
 
-  uint64_t last_time = 0;
-  uint64_t last_update_time = 0;
-  while (1) {
+  // the first full updates are staggered
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    RouterTimer first_update = {.kind = TIMER_UPDATE, .if_index = i};
+    timer_add(timer_now() + i * UPDATE_INTERVAL / N_IFACE_ON_BOARD, first_update);
+  }
+  RouterTimer first_snapshot = {.kind = TIMER_SNAPSHOT};
+  timer_add(timer_now() + SNAPSHOT_INTERVAL, first_snapshot);
+  RouterTimer first_check = {.kind = TIMER_XDP_NEIGHBOR};
+  timer_add(timer_now() + XDP_NEIGHBOR_CHECK, first_check);
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  // ports found down or readdressed are reported right away
+  if (HAL_SetInterfaceCallback(port_changed) != 0) {
+    printf("Link state is not monitored\n");
+  }
+  while (!stopping) {
     uint64_t time = HAL_GetTicks();
-    if (time > last_time + 5 * 1000) {
-      // What to do?
-      // send complete routing table to every interface
-      // ref. RFC2453 3.8
-      // multicast MAC for 224.0.0.9 is 01:00:5e:00:00:09
-      vector<RipPacket> rip;
-      for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
-        get_packet(&rip, i);
-        for (uint32_t j = 0; j < rip.size(); j++) {
-          uint32_t riplen = assemble(&(rip[j]), output);
-          uint32_t udplen = assembleUDP(output, riplen);
-          uint32_t iplen  = assembleIP(output, udplen, addrs[i], multicast_addr);   
-          macaddr_t multicast_mac;
-          HAL_ArpGetMacAddress(i, multicast_addr, multicast_mac);
-          HAL_SendIPPacket(i, output, iplen, multicast_mac);
-          #ifdef DEBUG_OUTPUT
-          printf("Timer send packet from %08x(%s) to %08x(%s), port %d, len is %d, dst mac is %s.\n", addrs[i], ip_string(addrs[i]).c_str(), multicast_addr, ip_string(multicast_addr).c_str(), i, iplen, mac_string(multicast_mac).c_str());
-          #endif
-        }
-      }   
-      print_all_entry();
-      printf("30s Timer\n");
-      last_time = time;
-    }
+    timer_advance(time, on_timer);
 
     int mask = (1 << N_IFACE_ON_BOARD) - 1;
     macaddr_t src_mac;
     macaddr_t dst_mac;
     int if_index;
+    // wake up in time for the next timer
+    int64_t timeout = timer_next(time + 1000) - time;
     res = HAL_ReceiveIPPacket(mask, packet, sizeof(packet), src_mac, dst_mac,
-                              1000, &if_index);
+                              timeout, &if_index);
     #ifdef DEBUG_OUTPUT
     printf("res: %d\n", res);
     #endif
@@ -133,11 +508,8 @@ int main(int argc, char *argv[]) {
       continue;
     }
 
-    // 1. validate
-    if (!validateIPChecksum(packet, res)) {
-      printf("Invalid IP Checksum\n");
-      continue;
-    }
+    // 1. validate: packets for us below, packets to forward by forward_fast
+    // in the same pass over the header that updates it
     in_addr_t src_addr, dst_addr;
     // extract src_addr and dst_addr from packet
     // big endian
@@ -166,8 +538,21 @@ int main(int argc, char *argv[]) {
 
 
     if (dst_is_me) {
+      if (!validateIPChecksum(packet, res)) {
+        printf("Invalid IP Checksum\n");
+        continue;
+      }
+      // BFD control packets from neighbors, see bfd.cpp
+      bool neighbor_lost;
+      if (bfd_receive(src_addr, if_index, packet, res, time, &neighbor_lost)) {
+        if (neighbor_lost) {
+          neighbor_down(src_addr, if_index, time);
+        }
+        continue;
+      }
       // 3a.1
-      RipPacket rip;
+      // entries are read in place from packet, which stays untouched until the next receive
+      RipView rip;
       // check and validate
       #ifdef DEBUG_OUTPUT
       printf("packet size: %d\n", sizeof(packet));
@@ -176,32 +561,23 @@ int main(int argc, char *argv[]) {
         //printf("%02x", packet[i]);
       }
       #endif
-      if (disassemble(packet, res, &rip)) {
+      // only the headers are checked here, entries are checked unless the
+      // fingerprint shows the same packet has already been checked and applied
+      if (parse_rip_header(packet, res, &rip)) {
         #ifdef DEBUG_OUTPUT
         rip.print();
         #endif
         if (rip.command == 1) {
+          if (!rip_entries_valid(rip)) {
+            continue;
+          }
           // 3a.3 request, ref. RFC2453 3.9.1
           // only need to respond to whole table requests in the lab
-          vector<RipPacket> resp;
-          // TODO: fill resp
-          get_packet(&resp, if_index);
-          // assemble
-          // IP
-          //output[0] = 0x45;
-          // ...
-          // UDP
-          // port = 520
-          //output[20] = 0x02;
-          //output[21] = 0x08;
-          // ...
-          // RIP
-          for (uint32_t j = 0; j < resp.size(); j++) {
-            uint32_t riplen = assemble(&(resp[j]), output);
-            uint32_t udplen = assembleUDP(output, riplen);
-            uint32_t iplen  = assembleIP(output, udplen, addrs[if_index], src_addr);
-            // checksum calculation for ip and udp
-            // if you don't want to calculate udp checksum, set it to zero
+          // the cached multicast packets are reused, only dst differs
+          for (uint32_t j = 0; j < advert_chunks(if_index); j++) {
+            uint32_t iplen;
+            memcpy(output, advert_wire(if_index, j, addrs[if_index], multicast_addr, &iplen), iplen);
+            rewriteIPDst(output, src_addr);
             // send it back
             HAL_SendIPPacket(if_index, output, iplen, src_mac);
             #ifdef DEBUG_OUTPUT
@@ -216,62 +592,86 @@ int main(int argc, char *argv[]) {
           // what is missing from RoutingTableEntry?
           // TODO: use query and update
           // triggered updates? ref. RFC2453 3.10.1
+          // a neighbor resends the same packets every cycle: when this one is
+          // identical to one already applied, only its routes' timeouts are refreshed
+          // a neighbor running BFD is only listened to while its session is up
+          if (bfd_blocked(src_addr, if_index)) {
+            continue;
+          }
+          // only validated packets get a fingerprint, so a hit needs no validation
+          uint64_t fingerprint = fp_compute(src_addr, if_index, rip);
+          uint32_t chunk = fp_lookup(fingerprint);
+          if (chunk == 0 && !rip_entries_valid(rip)) {
+            continue;
+          }
+          bfd_discover(src_addr, if_index, time);
+          shm_fib_neighbor(src_addr, if_index, src_mac);
+          if (chunk != 0) {
+            fp_refresh(chunk, time);
+            snapshot_neighbor(src_addr, if_index, src_mac);
+            continue;
+          }
+          chunk = fp_create(fingerprint, src_addr, if_index, time);
+          uint32_t expected = 0;
           bool trigger_flag = false;
+          bool withdrawals = false;
+          vector<FibDelta> deltas;
           for (uint32_t i = 0; i < rip.numEntries; i++) {
-            if (rip.entries[i].metric < 15) {
-              uint32_t nexthop, dest_if, metric;
-              //mask_len(rip.entries[i].mask);
-              RoutingTableEntry new_entry = {
-                .addr = rip.entries[i].addr,
-                .len = mask_len(rip.entries[i].mask),
-                .if_index = if_index,
+            uint32_t metric = rip.entries[i].metric_value();
+            uint32_t addr = rip.entries[i].addr & rip.entries[i].mask;
+            uint32_t len = mask_len(rip.entries[i].mask);
+            if (metric >= 15) {
+              // unreachable through this neighbor: a withdrawal, or the
+              // poisoned reverse of a route it learned from us
+              withdrawals = true;
+              if (rib_withdraw(addr, len, src_addr, if_index, &deltas)) {
+                trigger_flag = true;
+              }
+            } else {
+              // every neighbor's advertisement is kept in RIB, which compares
+              // it with the other candidates of the exact same prefix
+              RibCandidate cand = {
                 .nexthop = src_addr,
-                .metric = rip.entries[i].metric + 1
+                .if_index = (uint32_t)if_index,
+                .metric = metric + 1,
+                .updated = time,
+                .timer = 0,
+                .chunk = chunk
               };
-              if (query(rip.entries[i].addr, &nexthop, &dest_if, &metric)){
-                if (nexthop == src_addr && rip.entries[i].metric + 1 != metric){
-                  update(true, new_entry);
-                  trigger_flag = true;
-                }
-                else if(rip.entries[i].metric + 1 < metric) {
-                  update(true, new_entry);
-                  trigger_flag = true;
-                }
-              }
-              else {
-                update(true, new_entry);
+              expected++;
+              if (rib_update(addr, len, cand, &deltas)) {
                 trigger_flag = true;
               }
             }
           }
-          if (trigger_flag && time > last_update_time + 2 * 1000) {
-            last_update_time = time;
-            trigger_flag = false;
-            for (int i = 0; i < N_IFACE_ON_BOARD; i++) {
-              if (i != if_index){
-                vector<RipPacket> resp;
-                get_packet(&resp, i);
-                for (uint32_t j = 0;j < resp.size(); j++) {
-                  uint32_t riplen = assemble(&(resp[j]), output);
-                  uint32_t udplen = assembleUDP(output, riplen);
-                  uint32_t iplen  = assembleIP(output, udplen, addrs[i], src_addr);
-                  HAL_SendIPPacket(i, output, iplen, src_mac);
-                  #ifdef DEBUG_OUTPUT
-                  printf("Update send packet from %08x(%s) to %08x(%s), port %d, len is %d, dst mac is %s.\n", addrs[i], ip_string(addrs[i]).c_str(), src_addr, ip_string(src_addr).c_str(), i, iplen, mac_string(src_mac).c_str());
-                  #endif
-                }
-              }
-            }
+          fp_commit(chunk, expected, withdrawals);
+          stage_routes(deltas, time);
+          // a neighbor is kept for the snapshot while it has routes in RIB
+          if (withdrawals) {
+            snapshot_neighbor_prune();
+          }
+          snapshot_neighbor(src_addr, if_index, src_mac);
+          if (trigger_flag) {
+            schedule_triggered_update(time, has_withdrawal(deltas));
           }
           
         }
       }
+    } else if (offload || shared) {
+      // the kernel or a dataplane process forwards it
+      continue;
     } else {
       // 3b.1 dst is not me
       // forward
       // beware of endianness
-      uint32_t nexthop, dest_if, metric;
-      if (query(dst_addr, &nexthop, &dest_if, &metric)) {
+      // check the header and update ttl and checksum in place, before the lookup
+      // so that bad packets and expired ttl cost nothing more
+      if (!forward_fast(packet, res)) {
+        continue;
+      }
+      // equal-cost routes are spread per flow
+      uint32_t nexthop, dest_if;
+      if (query_flow(dst_addr, flow_hash(packet, res), &nexthop, &dest_if)) {
         // found
         macaddr_t dest_mac;
         // direct routing
@@ -280,18 +680,15 @@ int main(int argc, char *argv[]) {
           nexthop = dst_addr;
         }
         //printf("after nexthop: %08x(%s)\n", nexthop, ip_string(nexthop));
-        if (HAL_ArpGetMacAddress(dest_if, nexthop, dest_mac) == 0) {
+        bool resolved = HAL_ArpGetMacAddress(dest_if, nexthop, dest_mac) == 0;
+        if (resolved) {
+          // later packets to this neighbor take the XDP fast path
+          xdp_neighbor(nexthop, dest_if, dest_mac);
+        }
+        // a neighbor restored from the snapshot is used until ARP answers
+        if (resolved || snapshot_neighbor_mac(nexthop, dest_if, dest_mac)) {
           // found
-          memcpy(output, packet, res);
-
-          if(output[8] == 0){
-            printf("ttl = 0\n");
-            continue;
-          }
-          // update ttl and checksum
-          forward(output, res);
-          // TODO: you might want to check ttl=0 case
-          HAL_SendIPPacket(dest_if, output, res, dest_mac);
+          HAL_SendIPPacket(dest_if, packet, res, dest_mac);
           #ifdef DEBUG_OUTPUT
           printf("Send packet from %08x(%s) to %08x(%s), port %d, len is %d, dst mac is %s.\n", addrs[dest_if], ip_string(addrs[dest_if]).c_str(), dst_addr, ip_string(dst_addr).c_str(), dest_if, sizeof(packet), mac_string(dest_mac).c_str());
           #endif
@@ -307,6 +704,7 @@ int main(int argc, char *argv[]) {
       }
     }
   }
+  snapshot_save();
   //printf("%s", output);
   return 0;
 }
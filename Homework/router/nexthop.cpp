@@ -0,0 +1,155 @@
+#include "router.h"
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+
+/*
+  下一跳组表。相同成员的组只保存一份，FIB 表项里只记录组的编号。
+  不同的组的数量受邻居数量限制，远小于路由条数，所以组一旦建立就不再回收，
+  查找已有的组也只在控制面发生，线性扫描即可。
+  编号 0 保留，表示表项只有一条路径。
+  每个成员也记下它的邻接编号（见下面的备份路径表），成员失效时它的流改由其余成员分担。
+*/
+
+vector<NextHopGroup> groups(1);
+vector<uint32_t> group_adjacencies(ECMP_MAX_PATHS); // 组编号 * ECMP_MAX_PATHS + 成员下标 -> 邻接编号
+extern vector<uint8_t> adjacency_down;
+static uint32_t adjacency_intern(uint32_t nexthop, uint32_t if_index);
+
+/**
+ * @brief 取得成员完全相同的下一跳组的编号，不存在则新建
+ * @param group 下一跳组，size 至少为 2
+ * @return 组编号，大于 0
+ */
+uint32_t nhg_intern(const NextHopGroup &group) {
+  for (uint32_t i = 1; i < groups.size(); i++) {
+    if (groups[i].size == group.size &&
+        memcmp(groups[i].nexthop, group.nexthop, sizeof(uint32_t) * group.size) == 0 &&
+        memcmp(groups[i].if_index, group.if_index, sizeof(uint32_t) * group.size) == 0) {
+      return i;
+    }
+  }
+  groups.push_back(group);
+  for (uint32_t i = 0; i < ECMP_MAX_PATHS; i++) {
+    group_adjacencies.push_back(i < group.size ? adjacency_intern(group.nexthop[i], group.if_index[i]) : 0);
+  }
+  return groups.size() - 1;
+}
+
+/**
+ * @brief 按流的哈希值从下一跳组中选出一条路径，同一个流总是得到同一条路径
+ * @param id 组编号，大于 0
+ * @param hash 流哈希，见 flow_hash
+ *
+ * 选中的成员失效时，用哈希值映射到它的区间内的位置在其余没有失效的成员中再选一次，
+ * 它的流均匀地分给其余成员，原来走其它成员的流不受影响；全部失效时仍然返回选中的成员。
+ */
+void nhg_select(uint32_t id, uint32_t hash, uint32_t *nexthop, uint32_t *if_index) {
+  const NextHopGroup &group = groups[id];
+  // 用乘法把 hash 映射到 [0, size)，避免取模的除法
+  uint64_t scaled = (uint64_t)hash * group.size;
+  uint32_t i = scaled >> 32;
+  const uint32_t *adjacency = &group_adjacencies[id * ECMP_MAX_PATHS];
+  if (adjacency_down[adjacency[i]]) {
+    uint32_t live[ECMP_MAX_PATHS];
+    uint32_t count = 0;
+    for (uint32_t k = 0; k < group.size; k++) {
+      if (!adjacency_down[adjacency[k]]) {
+        live[count++] = k;
+      }
+    }
+    if (count > 0) {
+      i = live[((scaled & 0xFFFFFFFF) * count) >> 32];
+    }
+  }
+  *nexthop = group.nexthop[i];
+  *if_index = group.if_index[i];
+}
+
+const NextHopGroup *nhg_get(uint32_t id) {
+  return &groups[id];
+}
+
+/*
+  备份路径表。一条备份路径是 (主路径, 备份路径) ，主路径和备份路径都是一个邻接，
+  即 (nexthop, if_index) ，邻接和备份路径都只保存一份，FIB 表项里只记录备份路径的编号。
+  邻接失效时只需把它的标志置位，转发查询命中以它为主路径的表项时改用备份路径，
+  不用等 RIB 重新计算和写入 FIB 。与下一跳组一样建立后不再回收。
+*/
+
+typedef struct {
+  uint32_t primary; // 主路径的邻接编号
+  uint32_t nexthop;
+  uint32_t if_index;
+} BackupPath;
+
+vector<uint8_t> adjacency_down(1); // 邻接编号 -> 是否失效
+std::unordered_map<uint64_t, uint32_t> adjacencies; // (nexthop, if_index) -> 邻接编号
+vector<BackupPath> backups(1);
+std::unordered_map<uint64_t, uint32_t> backup_index; // (主路径邻接, 备份路径邻接) -> 编号
+
+static uint32_t adjacency_intern(uint32_t nexthop, uint32_t if_index) {
+  uint64_t key = ((uint64_t)nexthop << 32) | if_index;
+  std::unordered_map<uint64_t, uint32_t>::const_iterator it = adjacencies.find(key);
+  if (it != adjacencies.end()) {
+    return it->second;
+  }
+  uint32_t id = adjacency_down.size();
+  adjacency_down.push_back(0);
+  adjacencies[key] = id;
+  return id;
+}
+
+/**
+ * @brief 取得备份路径的编号，不存在则新建
+ * @return 编号，大于 0
+ */
+uint32_t backup_intern(uint32_t primary_nexthop, uint32_t primary_if, uint32_t nexthop, uint32_t if_index) {
+  uint32_t primary = adjacency_intern(primary_nexthop, primary_if);
+  uint64_t key = ((uint64_t)primary << 32) | adjacency_intern(nexthop, if_index);
+  std::unordered_map<uint64_t, uint32_t>::const_iterator it = backup_index.find(key);
+  if (it != backup_index.end()) {
+    return it->second;
+  }
+  BackupPath backup = {primary, nexthop, if_index};
+  backups.push_back(backup);
+  backup_index[key] = backups.size() - 1;
+  return backups.size() - 1;
+}
+
+/**
+ * @brief 标记一个邻接失效或恢复，以它为主路径的表项立即改用备份路径
+ */
+void adjacency_set_down(uint32_t nexthop, uint32_t if_index, bool down) {
+  std::unordered_map<uint64_t, uint32_t>::const_iterator it = adjacencies.find(((uint64_t)nexthop << 32) | if_index);
+  if (it != adjacencies.end()) {
+    adjacency_down[it->second] = down;
+  }
+}
+
+/**
+ * @brief 端口失效或恢复时标记这个端口上的所有邻接，在 RIB 撤销经过它的路由之前
+ *        就不再转发到这个端口
+ */
+void adjacency_set_port_down(uint32_t if_index, bool down) {
+  for (std::unordered_map<uint64_t, uint32_t>::const_iterator it = adjacencies.begin(); it != adjacencies.end(); it++) {
+    if ((uint32_t)it->first == if_index) {
+      adjacency_down[it->second] = down;
+    }
+  }
+}
+
+/**
+ * @brief 转发时检查表项的主路径，失效时选择备份路径
+ * @param id 备份路径编号，大于 0
+ * @return 主路径失效、写入了备份路径时返回 true
+ */
+bool backup_select(uint32_t id, uint32_t *nexthop, uint32_t *if_index) {
+  const BackupPath &backup = backups[id];
+  if (!adjacency_down[backup.primary]) {
+    return false;
+  }
+  *nexthop = backup.nexthop;
+  *if_index = backup.if_index;
+  return true;
+}
@@ -1,6 +1,9 @@
 #include "rip.h"
 #include <stdint.h>
 #include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /*
   在头文件 rip.h 中定义了如下的结构体：
@@ -29,6 +32,120 @@
   需要注意这里的地址都是用 **大端序** 存储的，1.2.3.4 对应 0x04030201 。
 */
 
+// 网络序的 mask 是否由连续的 1 与连续的 0 组成：取反后应当是 2^k - 1
+static inline uint32_t mask_invalid(uint32_t mask) {
+  uint32_t inv = ~__builtin_bswap32(mask);
+  return inv & (inv + 1);
+}
+
+/*
+  Family/Tag 和 Metric 按字节与期望值比较：对表项的每个字节 b ，
+  要求 ((b - one) ^ expect) & care == 0 。Family/Tag 和 Metric 的高三个字节必须等于期望值；
+  Metric 的最低字节减 1 之后只能是 0 到 15 ，即原值在 [1, 16] 中。
+  4 个表项正好 80 字节，SSE2 下每次比较 16 字节，没有分支。
+*/
+struct EntryPattern {
+  uint8_t one[80];
+  uint8_t expect[80];
+  uint8_t care[80];
+  EntryPattern(uint8_t family) {
+    for (uint32_t i = 0; i < 80; i++) {
+      uint32_t offset = i % 20;
+      one[i] = offset == 19 ? 1 : 0;
+      expect[i] = offset == 1 ? family : 0;
+      care[i] = offset < 4 || (offset >= 16 && offset < 19) ? 0xFF : (offset == 19 ? 0xF0 : 0);
+    }
+  }
+};
+
+static bool entries_valid(const uint8_t *p, uint32_t n, uint8_t command) {
+  static const EntryPattern request(0), response(2);
+  const EntryPattern &pattern = command == 2 ? response : request;
+  uint32_t i = 0;
+  uint32_t bad = 0;
+#ifdef __SSE2__
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    const uint8_t *block = p + i * 20;
+    for (uint32_t k = 0; k < 80; k += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(block + k));
+      v = _mm_sub_epi8(v, _mm_loadu_si128((const __m128i *)(pattern.one + k)));
+      v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)(pattern.expect + k)));
+      acc = _mm_or_si128(acc, _mm_and_si128(v, _mm_loadu_si128((const __m128i *)(pattern.care + k))));
+    }
+  }
+  bad |= _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) ^ 0xFFFF;
+#endif
+  for (; i < n; i++) {
+    const uint8_t *entry = p + i * 20;
+    for (uint32_t k = 0; k < 20; k++) {
+      bad |= ((uint8_t)(entry[k] - pattern.one[k]) ^ pattern.expect[k]) & pattern.care[k];
+    }
+  }
+  const RipWireEntry *entries = (const RipWireEntry *)p;
+  for (i = 0; i < n; i++) {
+    bad |= mask_invalid(entries[i].mask);
+  }
+  return bad == 0;
+}
+
+/**
+ * @brief 只校验 IP 包中 RIP 报文的 IP 、UDP 和 RIP 头部，不检查表项
+ * @param packet 接受到的 IP 包
+ * @param len 即 packet 的长度
+ * @param view 写入 command、numEntries 和指向 packet 中第一个表项的指针
+ * @return 头部是否合法
+ *
+ * 要求 IP 头的版本为 4 、协议为 UDP 、目的端口为 520 ，表项个数由 UDP 长度决定，
+ * UDP 长度必须恰好是 RIP 头加整数个表项。表项由 rip_entries_valid 校验，
+ * 这样与之前完全相同的 Response 可以先按指纹查到，不必逐项校验，见 fingerprint.cpp 。
+ */
+bool parse_rip_header(const uint8_t *packet, uint32_t len, RipView *view) {
+  if (len < 20) {
+    return false;
+  }
+  uint32_t ihl = (packet[0] & 0x0F) * 4;
+  uint32_t total_len = (packet[2] << 8) | packet[3];
+  if ((packet[0] >> 4) != 4 || ihl < 20 || total_len > len || total_len < ihl + 8 + 4 || packet[9] != 17) {
+    return false;
+  }
+  const uint8_t *udp = packet + ihl;
+  uint32_t udp_len = (udp[4] << 8) | udp[5];
+  if (((udp[2] << 8) | udp[3]) != 520 || udp_len < 8 + 4 || udp_len > total_len - ihl || (udp_len - 8 - 4) % 20 != 0) {
+    return false;
+  }
+  const uint8_t *rip = udp + 8;
+  uint8_t command = rip[0];
+  if ((command != 1 && command != 2) || rip[1] != 2 || rip[2] != 0 || rip[3] != 0) {
+    return false;
+  }
+  view->command = command;
+  view->numEntries = (udp_len - 8 - 4) / 20;
+  view->entries = (const RipWireEntry *)(rip + 4);
+  return true;
+}
+
+/**
+ * @brief 校验 parse_rip_header 得到的表项
+ * @return Family 、Tag 、Metric 和 Mask 是否都合法，要求同 disassemble
+ */
+bool rip_entries_valid(const RipView &view) {
+  return entries_valid((const uint8_t *)view.entries, view.numEntries, view.command);
+}
+
+/**
+ * @brief 校验 IP 包中的 RIP 协议数据，不拷贝表项
+ * @param packet 接受到的 IP 包
+ * @param len 即 packet 的长度
+ * @param view 写入 command、numEntries 和指向 packet 中第一个表项的指针
+ * @return 是否是合法的 RIP 包
+ *
+ * 除了 disassemble 要求的检查，头部的要求见 parse_rip_header 。
+ */
+bool parse_rip(const uint8_t *packet, uint32_t len, RipView *view) {
+  return parse_rip_header(packet, len, view) && rip_entries_valid(*view);
+}
+
 /**
  * @brief 从接受到的 IP 包解析出 Rip 协议的数据
  * @param packet 接受到的 IP 包
@@ -42,61 +159,22 @@
  * Family 和 Command 是否有正确的对应关系（见上面结构体注释），Tag 是否为 0，
  * Metric 转换成小端序后是否在 [1,16] 的区间内，
  * Mask 的二进制是不是连续的 1 与连续的 0 组成等等。
+ *
+ * 校验由 parse_rip 完成，超过 RIP_MAX_ENTRY 项的包放不进 RipPacket ，视为不合法。
  */
 bool disassemble(const uint8_t *packet, uint32_t len, RipPacket *output) {
-  // TODO:
-
-  uint16_t total_len = (packet[2] << 8) | (packet[3]);
-  if (total_len > len) {
+  RipView view;
+  if (!parse_rip(packet, len, &view) || view.numEntries > RIP_MAX_ENTRY) {
     return false;
   }
-  uint8_t command = packet[28];
-  uint8_t version = packet[29];
-  uint8_t zero = packet[30] | packet[31];
-
-  //output = new RipPacket();
-  output->command = command;
-  output->numEntries = (len - 31) / 20;
-
-  for (uint32_t i = 0; i < output->numEntries; i++) {
-    //uint32_t numEntries = (len - 31) / 20;
-    uint16_t family = (packet[32 + i * 20] << 8) | (packet[33 + i * 20]);
-    uint8_t tag = packet[34 + i * 20] | packet[35 + i * 20];
-    if (!(((command == 2 && family == 2) || (command == 1 && family == 0)) && version == 2 && zero == 0 && tag == 0)) {
-      printf("command: %d, family: %d, version: %d, zero: %d, tag: %d, error 1\n");
-      return false;
-    }
-    uint32_t addr = (packet[36 + i * 20]) | (packet[37 + i * 20] << 8) | (packet[38 + i * 20] << 16) | (packet[39 + i * 20] << 24);
-    uint32_t mask = (packet[40 + i * 20]) | (packet[41 + i * 20] << 8) | (packet[42 + i * 20] << 16) | (packet[43 + i * 20] << 24);
-    uint32_t nexthop = (packet[44 + i * 20]) | (packet[45 + i * 20] << 8) | (packet[46 + i * 20] << 16) | (packet[47 + i * 20] << 24);
-    uint32_t metric = (packet[48 + i * 20] << 24) | (packet[49 + i * 20] << 16) | (packet[50 + i * 20] << 8) | (packet[51 + i * 20]);
-    uint32_t metric_small = (packet[51 + i * 20] << 24) | (packet[50 + i * 20] << 16) | (packet[49 + i * 20] << 8) | (packet[48 + i * 20]);
-    if (metric < 1 || metric > 16) {
-      printf("error 2\n");
-      return false;
-    }
-    bool flag = true;
-    bool before = ((mask & 0x1) != 0);
-    for (int i = 0; i < 32; i++) {
-      uint32_t mask_mask = (0x00000001 << i);
-      bool now = ((mask & mask_mask) != 0);
-      if (now ^ before) {
-        if (flag) {
-          flag = false;
-        }
-        else {
-      printf("error 3\n");
-          return false;
-        }
-      }
-      before = now;
-    }
-    output->entries[i].addr = addr;
-    output->entries[i].mask = mask;
-    output->entries[i].nexthop = nexthop;
-    output->entries[i].metric = metric;
+  output->command = view.command;
+  output->numEntries = view.numEntries;
+  for (uint32_t i = 0; i < view.numEntries; i++) {
+    output->entries[i].addr = view.entries[i].addr;
+    output->entries[i].mask = view.entries[i].mask;
+    output->entries[i].nexthop = view.entries[i].nexthop;
+    output->entries[i].metric = view.entries[i].metric_value();
   }
-
   return true;
 }
 
@@ -157,6 +235,47 @@ uint32_t assembleUDP(uint8_t *buffer, uint32_t riplen) {
   return len;
 }
 
+/**
+ * @brief 计算 20 字节 IP 头的校验和，校验和字段按 0 处理
+ * @return 主机序的校验和，高字节写入 buffer[10]
+ *
+ * 按 16 位一次累加，最后再折叠进位，而不是每加一个字节就折叠一次。
+ */
+uint16_t ipHeaderChecksum(const uint8_t *buffer) {
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < 20; i += 2) {
+    sum += (buffer[i] << 8) | buffer[i + 1];
+  }
+  sum -= (buffer[10] << 8) | buffer[11];
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  sum += sum >> 16;
+  return ~sum & 0xFFFF;
+}
+
+/**
+ * @brief 修改已经组装好的 IP 包的目的地址，按 RFC 1624 增量更新校验和
+ * @param buffer IP 包
+ * @param dst 新的目的地址，大端序
+ */
+void rewriteIPDst(uint8_t *buffer, uint32_t dst) {
+  uint32_t sum = ~((buffer[10] << 8) | buffer[11]) & 0xFFFF;
+  for (uint32_t i = 16; i < 20; i += 2) {
+    sum += ~((buffer[i] << 8) | buffer[i + 1]) & 0xFFFF;
+  }
+  buffer[16] = (dst & 0x000000FF);
+  buffer[17] = ((dst >> 8) & 0x000000FF);
+  buffer[18] = ((dst >> 16) & 0x000000FF);
+  buffer[19] = ((dst >> 24) & 0x000000FF);
+  for (uint32_t i = 16; i < 20; i += 2) {
+    sum += (buffer[i] << 8) | buffer[i + 1];
+  }
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  sum += sum >> 16;
+  sum = ~sum & 0xFFFF;
+  buffer[10] = sum >> 8;
+  buffer[11] = sum & 0xFF;
+}
+
 uint32_t assembleIP(uint8_t *buffer, uint32_t udplen, uint32_t src, uint32_t dst) {
   uint32_t len = udplen + 20;
   buffer[0] = ((4 << 4) + 5);
@@ -180,16 +299,9 @@ uint32_t assembleIP(uint8_t *buffer, uint32_t udplen, uint32_t src, uint32_t dst
   buffer[18] = ((dst >> 16) & 0x000000FF);
   buffer[19] = ((dst >> 24) & 0x000000FF);
 
-  int32_t sum = 0;
-  for (uint8_t i = 0; i < (5 << 2); i += 2) {
-    sum += (buffer[i] << 8) + (buffer[i + 1]);
-    while((sum & 0xFFFF0000) != 0) {
-      sum = ((sum >> 16) & 0x0000FFFF) + (sum & 0x0000FFFF);
-    }
-  }
-  sum = ~sum;
-  buffer[10] = ((sum >> 8) & 0x000000FF);
-  buffer[11] = (sum & 0x000000FF);
+  uint16_t sum = ipHeaderChecksum(buffer);
+  buffer[10] = sum >> 8;
+  buffer[11] = sum & 0xFF;
 
 
   return len;
@@ -0,0 +1,437 @@
+#include "rib.h"
+#include "prefix_hash.h"
+#include "timer.h"
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+
+extern uint32_t nhg_intern(const NextHopGroup &group);
+extern uint32_t backup_intern(uint32_t primary_nexthop, uint32_t primary_if, uint32_t nexthop, uint32_t if_index);
+extern uint32_t timer_add(uint64_t expire, RouterTimer timer);
+extern void timer_modify(uint32_t id, uint64_t expire);
+extern void timer_cancel(uint32_t id);
+extern uint64_t fp_last_seen(uint32_t id);
+extern void fp_link(uint32_t id);
+extern void fp_unlink(uint32_t id);
+extern void fp_learned(uint32_t id);
+
+/*
+  RIB（Routing Information Base）按精确前缀 (addr, len) 保存所有候选路由，
+  每个邻居的通告各占一项；FIB（即 lookup.cpp 里的路由表）只保存每个前缀的最优路由。
+  RIB 的每次修改只把最优路由的变化以 FibDelta 的形式追加到 deltas 中，
+  由 fib_apply 应用到 FIB，这样 FIB 的更新代价只与变化量有关。
+  与最优路由 metric 相同的其它候选（最多 ECMP_MAX_PATHS 条）组成下一跳组一起进入 FIB。
+  只有一条最优路径时，另选一个无环的候选作为备份路径一起进入 FIB ，主路径失效时由
+  转发面直接切换。
+  前缀到节点的索引是哈希表，处理一条 RIP 表项时找到、替换或删除路由都是 O(1)。
+
+  邻居通告的候选各有一个 ROUTE_TIMEOUT 的超时定时器，收到通告时顺延。
+  超时导致前缀失去所有候选时进入抑制期（hold-down），期间只接受不比失效路由差的通告，
+  节点保留到抑制期结束。
+  邻居重发同样的包时只刷新包对应的 chunk ，候选的定时器到期时再按 chunk 的 last_seen 顺延。
+*/
+
+struct RibNode {
+  vector<RibCandidate> candidates;
+  int best = -1; // candidates 中最优项的下标，-1 表示没有候选
+  uint32_t group = 0; // 当前的下一跳组，0 表示只有一条路径
+  uint32_t backup = 0; // 当前的备份路径，0 表示没有
+  uint32_t holddown = 0; // 抑制期定时器的编号，0 表示不在抑制期
+  uint32_t holddown_metric = 0; // 失效路由的 metric
+};
+
+vector<RibNode> rib_nodes;
+vector<uint32_t> free_nodes;
+PrefixHash<uint32_t> rib_index; // (addr, len) -> rib_nodes 的下标
+std::unordered_map<uint64_t, uint32_t> neighbor_candidates; // (邻居地址, 端口) -> 它通告的候选个数
+
+// 邻居通告的候选加入或离开 RIB 时计数，直连/静态路由不计
+static void count_candidate(const RibCandidate &cand, int delta) {
+  if (cand.updated == 0) {
+    return;
+  }
+  uint64_t k = ((uint64_t)cand.nexthop << 32) | cand.if_index;
+  uint32_t &count = neighbor_candidates[k];
+  count += delta;
+  if (count == 0) {
+    neighbor_candidates.erase(k);
+  }
+}
+
+static void free_node(uint32_t addr, uint32_t len, uint32_t id) {
+  rib_index.erase(addr, len);
+  rib_nodes[id].candidates.clear();
+  rib_nodes[id].best = -1;
+  rib_nodes[id].group = 0;
+  rib_nodes[id].backup = 0;
+  rib_nodes[id].holddown = 0;
+  free_nodes.push_back(id);
+}
+
+// metric 最小者最优，相同时保留原来的最优项，避免来回切换
+static int select_best(const RibNode &node) {
+  int best = -1;
+  for (int i = 0; i < (int)node.candidates.size(); i++) {
+    if (best == -1 || node.candidates[i].metric < node.candidates[best].metric ||
+        (node.candidates[i].metric == node.candidates[best].metric && i == node.best)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+// 最优项排在第一位，其余 metric 相同的候选按顺序跟在后面
+static uint32_t ecmp_group(const RibNode &node) {
+  const RibCandidate &best = node.candidates[node.best];
+  NextHopGroup group;
+  group.size = 1;
+  group.nexthop[0] = best.nexthop;
+  group.if_index[0] = best.if_index;
+  for (int i = 0; i < (int)node.candidates.size() && group.size < ECMP_MAX_PATHS; i++) {
+    if (i != node.best && node.candidates[i].metric == best.metric) {
+      group.nexthop[group.size] = node.candidates[i].nexthop;
+      group.if_index[group.size] = node.candidates[i].if_index;
+      group.size++;
+    }
+  }
+  return group.size > 1 ? nhg_intern(group) : 0;
+}
+
+// 无环备份路径（LFA, RFC5286）：来自另一个来源，满足
+// Distance(N, D) < Distance(N, S) + Distance(S, D) 的候选，N 到本机 S 的距离是 1 ，
+// 即它通告的 metric（候选的 metric 减 1）小于最优路由的 metric 加 1 ，N 的路径不经过本机。
+// 优先选出端口与主路径不同的，端口失效时也能用，其次 metric 小的
+static uint32_t lfa_backup(const RibNode &node) {
+  const RibCandidate &best = node.candidates[node.best];
+  int res = -1;
+  for (int i = 0; i < (int)node.candidates.size(); i++) {
+    const RibCandidate &c = node.candidates[i];
+    if (i == node.best || c.metric - 1 >= best.metric + 1) {
+      continue;
+    }
+    if (res == -1) {
+      res = i;
+      continue;
+    }
+    const RibCandidate &r = node.candidates[res];
+    bool c_other = c.if_index != best.if_index, r_other = r.if_index != best.if_index;
+    if (c_other != r_other ? c_other : c.metric < r.metric) {
+      res = i;
+    }
+  }
+  if (res == -1) {
+    return 0;
+  }
+  return backup_intern(best.nexthop, best.if_index, node.candidates[res].nexthop, node.candidates[res].if_index);
+}
+
+static RoutingTableEntry to_entry(uint32_t addr, uint32_t len, const RibNode &node) {
+  const RibCandidate &c = node.candidates[node.best];
+  RoutingTableEntry entry = {
+    .addr = addr,
+    .len = len,
+    .if_index = c.if_index,
+    .nexthop = c.nexthop,
+    .metric = c.metric,
+    .group = node.group,
+    .backup = node.backup,
+    .learned = c.updated != 0
+  };
+  return entry;
+}
+
+// 重新选择最优路由，如果 FIB 可见的内容发生变化则输出增量，返回最优路由是否变化
+// （只有备份路径变化时输出增量，但返回 false）
+// 没有候选时，抑制期中的节点保留，否则释放
+static bool reselect(uint32_t id, uint32_t addr, uint32_t len, const RoutingTableEntry *old_entry, vector<FibDelta> *deltas) {
+  RibNode &node = rib_nodes[id];
+  node.best = select_best(node);
+  if (node.best == -1) {
+    if (node.holddown == 0) {
+      free_node(addr, len, id);
+    }
+    if (old_entry == NULL) {
+      return false;
+    }
+    FibDelta delta = {false, *old_entry};
+    deltas->push_back(delta);
+    return true;
+  }
+  node.group = ecmp_group(node);
+  node.backup = node.group == 0 ? lfa_backup(node) : 0;
+  RoutingTableEntry now = to_entry(addr, len, node);
+  bool changed = old_entry == NULL || old_entry->nexthop != now.nexthop || old_entry->if_index != now.if_index ||
+                 old_entry->metric != now.metric || old_entry->group != now.group ||
+                 old_entry->learned != now.learned;
+  if (changed || old_entry->backup != now.backup) {
+    FibDelta delta = {true, now};
+    deltas->push_back(delta);
+  }
+  return changed;
+}
+
+// 同一来源的候选的下标，没有则返回 candidates.size()
+static uint32_t find_candidate(const RibNode &node, uint32_t nexthop, uint32_t if_index) {
+  uint32_t i = 0;
+  while (i < node.candidates.size() && !(node.candidates[i].nexthop == nexthop && node.candidates[i].if_index == if_index)) {
+    i++;
+  }
+  return i;
+}
+
+// 按 updated 设置、顺延或取消候选的超时定时器
+static void refresh_timer(uint32_t addr, uint32_t len, RibCandidate *cand) {
+  if (cand->updated == 0) {
+    if (cand->timer != 0) {
+      timer_cancel(cand->timer);
+      cand->timer = 0;
+    }
+  } else if (cand->timer != 0) {
+    timer_modify(cand->timer, cand->updated + ROUTE_TIMEOUT);
+  } else {
+    RouterTimer timer = {
+      .kind = TIMER_ROUTE_TIMEOUT,
+      .addr = addr,
+      .len = len,
+      .nexthop = cand->nexthop,
+      .if_index = cand->if_index
+    };
+    cand->timer = timer_add(cand->updated + ROUTE_TIMEOUT, timer);
+  }
+}
+
+// 删除第 i 个候选，不处理它的定时器
+static bool remove_candidate(uint32_t id, uint32_t addr, uint32_t len, uint32_t i, vector<FibDelta> *deltas) {
+  RibNode &node = rib_nodes[id];
+  RoutingTableEntry old_entry = to_entry(addr, len, node);
+  count_candidate(node.candidates[i], -1);
+  node.candidates.erase(node.candidates.begin() + i);
+  if ((int)i < node.best) {
+    node.best--;
+  } else if ((int)i == node.best) {
+    node.best = -1;
+  }
+  return reselect(id, addr, len, &old_entry, deltas);
+}
+
+/**
+ * @brief 插入或替换一条候选路由
+ * @param addr 前缀，大端序，仅前 len 位可能非零
+ * @param len 前缀长度
+ * @param cand 候选路由，按 (nexthop, if_index) 区分来源，同一来源的旧通告会被替换
+ * @param deltas FIB 的变化追加到这里
+ * @return 该前缀的最优路由是否发生变化
+ */
+bool rib_update(uint32_t addr, uint32_t len, RibCandidate cand, vector<FibDelta> *deltas) {
+  uint32_t *found_id = rib_index.find(addr, len);
+  uint32_t id;
+  if (found_id != NULL) {
+    id = *found_id;
+  } else if (!free_nodes.empty()) {
+    id = free_nodes.back();
+    free_nodes.pop_back();
+    rib_index.insert(addr, len, id);
+  } else {
+    id = rib_nodes.size();
+    rib_nodes.push_back(RibNode());
+    rib_index.insert(addr, len, id);
+  }
+  RibNode &node = rib_nodes[id];
+  if (node.holddown != 0 && node.candidates.empty()) {
+    if (cand.metric > node.holddown_metric) {
+      return false;
+    }
+    timer_cancel(node.holddown);
+    node.holddown = 0;
+  }
+  bool has_old = node.best != -1;
+  RoutingTableEntry old_entry;
+  if (has_old) {
+    old_entry = to_entry(addr, len, node);
+  }
+  uint32_t i = find_candidate(node, cand.nexthop, cand.if_index);
+  uint32_t old_chunk = 0;
+  if (i < node.candidates.size()) {
+    cand.timer = node.candidates[i].timer;
+    old_chunk = node.candidates[i].chunk;
+    if ((node.candidates[i].updated == 0) != (cand.updated == 0)) {
+      count_candidate(node.candidates[i], -1);
+      count_candidate(cand, 1);
+    }
+    node.candidates[i] = cand;
+  } else {
+    cand.timer = 0;
+    count_candidate(cand, 1);
+    node.candidates.push_back(cand);
+    if (cand.chunk != 0) {
+      fp_learned(cand.chunk);
+    }
+  }
+  if (cand.chunk != old_chunk) {
+    if (cand.chunk != 0) {
+      fp_link(cand.chunk);
+    }
+    if (old_chunk != 0) {
+      fp_unlink(old_chunk);
+    }
+  }
+  refresh_timer(addr, len, &node.candidates[i]);
+  return reselect(id, addr, len, has_old ? &old_entry : NULL, deltas);
+}
+
+/**
+ * @brief 删除某个来源对一个前缀的候选路由
+ * @return 该前缀的最优路由是否发生变化
+ */
+bool rib_withdraw(uint32_t addr, uint32_t len, uint32_t nexthop, uint32_t if_index, vector<FibDelta> *deltas) {
+  uint32_t *id = rib_index.find(addr, len);
+  if (id == NULL) {
+    return false;
+  }
+  RibNode &node = rib_nodes[*id];
+  uint32_t i = find_candidate(node, nexthop, if_index);
+  if (i == node.candidates.size()) {
+    return false;
+  }
+  if (node.candidates[i].timer != 0) {
+    timer_cancel(node.candidates[i].timer);
+  }
+  if (node.candidates[i].chunk != 0) {
+    fp_unlink(node.candidates[i].chunk);
+  }
+  return remove_candidate(*id, addr, len, i, deltas);
+}
+
+/**
+ * @brief 删除某个邻居的所有候选路由，BFD 发现邻居失效时使用
+ * @return 删除的候选个数
+ *
+ * 遍历整个 RIB ，只在邻居失效时调用一次。
+ */
+uint32_t rib_withdraw_neighbor(uint32_t nexthop, uint32_t if_index, vector<FibDelta> *deltas) {
+  // 删除会修改 rib_index ，先找出所有前缀
+  vector<std::pair<uint32_t, uint32_t> > prefixes;
+  rib_index.for_each([&](uint32_t addr, uint32_t len, uint32_t id) {
+    const RibNode &node = rib_nodes[id];
+    if (find_candidate(node, nexthop, if_index) != node.candidates.size()) {
+      prefixes.push_back(std::make_pair(addr, len));
+    }
+  });
+  for (uint32_t k = 0; k < prefixes.size(); k++) {
+    rib_withdraw(prefixes[k].first, prefixes[k].second, nexthop, if_index, deltas);
+  }
+  return prefixes.size();
+}
+
+/**
+ * @brief 删除从某个端口学到的所有候选路由，端口链路断开时使用；直连和静态路由不受影响
+ * @return 删除的候选个数
+ */
+uint32_t rib_withdraw_port(uint32_t if_index, vector<FibDelta> *deltas) {
+  struct Learned {
+    uint32_t addr, len, nexthop;
+  };
+  vector<Learned> learned;
+  rib_index.for_each([&](uint32_t addr, uint32_t len, uint32_t id) {
+    const vector<RibCandidate> &candidates = rib_nodes[id].candidates;
+    for (uint32_t i = 0; i < candidates.size(); i++) {
+      if (candidates[i].if_index == if_index && candidates[i].updated != 0) {
+        Learned l = {addr, len, candidates[i].nexthop};
+        learned.push_back(l);
+      }
+    }
+  });
+  for (uint32_t k = 0; k < learned.size(); k++) {
+    rib_withdraw(learned[k].addr, learned[k].len, learned[k].nexthop, if_index, deltas);
+  }
+  return learned.size();
+}
+
+/**
+ * @brief 一条候选路由的超时定时器到期，删除它；前缀因此不可达时进入抑制期
+ * @param now 当前时间，毫秒
+ * @return 该前缀的最优路由是否发生变化
+ */
+bool rib_expire(uint32_t addr, uint32_t len, uint32_t nexthop, uint32_t if_index, uint64_t now, vector<FibDelta> *deltas) {
+  uint32_t *id = rib_index.find(addr, len);
+  if (id == NULL) {
+    return false;
+  }
+  RibNode &node = rib_nodes[*id];
+  uint32_t i = find_candidate(node, nexthop, if_index);
+  if (i == node.candidates.size()) {
+    return false;
+  }
+  // 定时器已经到期，编号不再属于它
+  RibCandidate &cand = node.candidates[i];
+  cand.timer = 0;
+  if (cand.chunk != 0) {
+    // 之后收到过同样的包，顺延
+    uint64_t last_seen = fp_last_seen(cand.chunk);
+    if (last_seen + ROUTE_TIMEOUT > now) {
+      cand.updated = last_seen;
+      refresh_timer(addr, len, &cand);
+      return false;
+    }
+    fp_unlink(cand.chunk);
+  }
+  if (node.candidates.size() == 1 && node.holddown == 0) {
+    RouterTimer timer = {
+      .kind = TIMER_HOLDDOWN,
+      .addr = addr,
+      .len = len
+    };
+    node.holddown = timer_add(now + ROUTE_HOLDDOWN, timer);
+    node.holddown_metric = node.candidates[0].metric;
+  }
+  return remove_candidate(*id, addr, len, i, deltas);
+}
+
+/**
+ * @brief 抑制期定时器到期，之后照常接受任何通告
+ */
+void rib_holddown_end(uint32_t addr, uint32_t len) {
+  uint32_t *id = rib_index.find(addr, len);
+  if (id == NULL) {
+    return;
+  }
+  RibNode &node = rib_nodes[*id];
+  node.holddown = 0;
+  if (node.candidates.empty()) {
+    free_node(addr, len, *id);
+  }
+}
+
+/**
+ * @brief 一个邻居通告的、仍在 RIB 中的候选路由个数
+ */
+uint32_t rib_neighbor_routes(uint32_t nexthop, uint32_t if_index) {
+  std::unordered_map<uint64_t, uint32_t>::const_iterator it = neighbor_candidates.find(((uint64_t)nexthop << 32) | if_index);
+  return it == neighbor_candidates.end() ? 0 : it->second;
+}
+
+/**
+ * @brief 导出所有前缀的最优路由，顺序不定，可以直接交给 build 建立 FIB
+ */
+void rib_best_routes(vector<RoutingTableEntry> *res) {
+  rib_index.for_each([&](uint32_t addr, uint32_t len, uint32_t id) {
+    if (rib_nodes[id].best != -1) {
+      res->push_back(to_entry(addr, len, rib_nodes[id]));
+    }
+  });
+}
+
+/**
+ * @brief 导出所有邻居通告的候选路由，不含直连和静态路由，顺序不定
+ */
+void rib_learned(vector<RibRoute> *res) {
+  rib_index.for_each([&](uint32_t addr, uint32_t len, uint32_t id) {
+    const vector<RibCandidate> &candidates = rib_nodes[id].candidates;
+    for (uint32_t i = 0; i < candidates.size(); i++) {
+      if (candidates[i].updated != 0) {
+        RibRoute route = {addr, len, candidates[i]};
+        res->push_back(route);
+      }
+    }
+  });
+}
@@ -0,0 +1,30 @@
+#ifndef RIB_H
+#define RIB_H
+
+#include "router.h"
+#include <stdint.h>
+
+// RIB 中一条候选路由：某个邻居对一个前缀的通告，或者直连/静态路由
+typedef struct {
+    uint32_t nexthop; // 大端序，0 表示直连
+    uint32_t if_index; // 出端口编号
+    uint32_t metric; // 已经加上到邻居的开销
+    uint64_t updated; // 最近一次收到通告的时间，毫秒，0 表示直连/静态路由，不会超时
+    uint32_t timer; // 超时定时器的编号，由 RIB 维护
+    uint32_t chunk; // 带来这条通告的包的 chunk 编号（见 fingerprint.cpp），0 表示没有
+} RibCandidate;
+
+// 一条邻居通告的候选路由及其前缀，用于保存快照（见 snapshot.cpp）
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    RibCandidate cand;
+} RibRoute;
+
+// 一次 FIB 变更：插入/替换或删除一个前缀的最优路由
+typedef struct {
+    bool insert; // true 表示插入或替换，false 表示删除
+    RoutingTableEntry entry;
+} FibDelta;
+
+#endif
@@ -22,4 +22,27 @@ typedef struct {
   void print() {
     printf("commmand: %d, num: %d\n", command, numEntries);
   }
-} RipPacket;
\ No newline at end of file
+} RipPacket;
+
+// 报文中一个 RIP 表项的原始格式，RipView 直接指向收到的报文
+typedef struct __attribute__((packed)) {
+  uint16_t family; // 网络序
+  uint16_t tag;
+  uint32_t addr; // 与 RipEntry 相同，大端序
+  uint32_t mask;
+  uint32_t nexthop;
+  uint32_t metric; // 网络序，用 metric_value() 得到数值
+  uint32_t metric_value() const {
+    return __builtin_bswap32(metric);
+  }
+} RipWireEntry;
+
+// 校验过的 RIP 包，entries 指向报文内部，报文缓冲区被覆盖之前有效
+typedef struct {
+  uint32_t numEntries;
+  uint8_t command;
+  const RipWireEntry *entries;
+  void print() {
+    printf("commmand: %d, num: %d\n", command, numEntries);
+  }
+} RipView;
@@ -18,9 +18,34 @@ typedef struct {
     uint32_t nexthop; // 下一条的地址，0 表示直连
     // 为了实现 RIP 协议，需要在这里添加额外的字段
     uint32_t metric;
+    uint32_t group; // 等价多路径的下一跳组编号，0 表示只有 nexthop/if_index 这一条路径
+    uint32_t backup; // 主路径失效时使用的备份路径编号（见 nexthop.cpp），0 表示没有
+    bool learned; // 是否从邻居学到，直连/静态路由为 false
     void print() {
-        printf("Routing Table Entry:\n\taddr: %08x(%s)\n\tlen: %d\n\tif_index: %d\n\tnexthop: %08x(%s)\n\tmetric: %d\n", addr, ip_string(addr).c_str(), len, if_index, nexthop, ip_string(nexthop).c_str(), metric);
+        printf("Routing Table Entry:\n\taddr: %08x(%s)\n\tlen: %d\n\tif_index: %d\n\tnexthop: %08x(%s)\n\tmetric: %d\n\tgroup: %d\n\tbackup: %d\n\tlearned: %d\n", addr, ip_string(addr).c_str(), len, if_index, nexthop, ip_string(nexthop).c_str(), metric, group, backup, learned);
     }
 } RoutingTableEntry;
 
+// 一个下一跳组最多包含的等价路径数
+#define ECMP_MAX_PATHS 4
+
+// 等价多路径的下一跳组，成员按加入顺序排列，第一个与表项中的 nexthop/if_index 相同
+typedef struct {
+    uint32_t size;
+    uint32_t nexthop[ECMP_MAX_PATHS];
+    uint32_t if_index[ECMP_MAX_PATHS];
+} NextHopGroup;
+
+// 控制进程发布转发表、数据面进程映射的共享内存，见 shm_fib.cpp
+#define SHM_FIB_NAME "/router-fib"
+
+// 前缀长度对应的掩码，和地址一样是大端序，例如 /20 对应 0x00F0FFFF
+inline uint32_t len_to_mask(uint32_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    uint32_t mask = 0xFFFFFFFF << (32 - len);
+    return (mask >> 24) | ((mask >> 8) & 0x0000FF00) | ((mask << 8) & 0x00FF0000) | (mask << 24);
+}
+
 #endif
\ No newline at end of file
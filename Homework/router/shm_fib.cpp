@@ -0,0 +1,117 @@
+#include "router.h"
+#include "router_hal.h"
+#include "routing_table.h"
+#include "shm_fib.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+
+/*
+  把压缩后的 fib 和 RIP 邻居的 MAC 地址发布到共享内存（SHM_FIB 不为 0 时），
+  由若干个 dataplane 进程（见 dataplane.cpp ，每个负责一部分端口，可以绑定到不同的 CPU）
+  只读映射后转发，本进程只运行 RIP 控制面。共享内存的布局和并发协议见 Homework/common/shm_fib.h 。
+
+  fib 变化时只做标记，fib_commit 和 build 结束时重建整张区间表发布一次，
+  批量提交使一次邻居的整表通告只发布一次。邻居的 MAC 地址取自它发来的 RIP 报文的
+  源 MAC ，不需要额外的 ARP ；直连主机由数据面自己 ARP 。
+  备份路径的切换只在本进程中，数据面在主路径失效到 RIB 删除路由之间仍然使用主路径。
+
+  共享内存在进程退出后保留，重启的控制进程或数据面进程映射后立即可用。
+*/
+
+#ifndef SHM_FIB
+#define SHM_FIB 0 // 0 表示不使用
+#endif
+
+bool shm_fib_enabled = false;
+bool shm_fib_dirty = false;
+ShmFib<NextHopGroup> shm_fib;
+std::unordered_map<uint64_t, uint64_t> shm_fib_macs; // 已经写入的邻居，避免重复写入
+
+extern RoutingTable<ROUTING_ENGINE<RoutingTableEntry> > fib;
+extern const NextHopGroup *nhg_get(uint32_t id);
+
+/**
+ * @brief 创建共享内存，SHM_FIB 为 0 时什么也不做
+ * @param if_addrs 每个端口的 IPv4 地址
+ * @return 成功时返回 true ，此后由数据面进程转发
+ */
+bool shm_fib_open(const in_addr_t *if_addrs) {
+  if (SHM_FIB == 0) {
+    return false;
+  }
+  if (!shm_fib.create(SHM_FIB_NAME)) {
+    printf("Shared FIB: failed to create %s: %s\n", SHM_FIB_NAME, strerror(errno));
+    return false;
+  }
+  shm_fib.set_ports(if_addrs, N_IFACE_ON_BOARD);
+  shm_fib_enabled = true;
+  return true;
+}
+
+/**
+ * @brief 端口地址变化时更新共享内存中的地址
+ */
+void shm_fib_ports(const in_addr_t *if_addrs) {
+  if (shm_fib_enabled) {
+    shm_fib.set_ports(if_addrs, N_IFACE_ON_BOARD);
+  }
+}
+
+/**
+ * @brief 压缩后的 fib 的一次变化，参数与 update 相同，只标记需要重新发布
+ */
+void shm_fib_route(bool insert, const RoutingTableEntry &entry) {
+  shm_fib_dirty = true;
+}
+
+/**
+ * @brief fib 有变化时重建区间表并发布
+ */
+void shm_fib_publish() {
+  if (!shm_fib_enabled || !shm_fib_dirty) {
+    return;
+  }
+  vector<ShmFibPrefix<NextHopGroup> > prefixes;
+  prefixes.reserve(fib.size());
+  fib.for_each([&](const RoutingTableEntry &entry) {
+    // 没有用到的成员为零，动作按字节比较
+    ShmFibPrefix<NextHopGroup> prefix;
+    memset(&prefix, 0, sizeof(prefix));
+    prefix.key = rt_key(entry.addr);
+    prefix.len = entry.len;
+    if (entry.group != 0) {
+      prefix.action = *nhg_get(entry.group);
+    } else {
+      prefix.action.size = 1;
+      prefix.action.nexthop[0] = entry.nexthop;
+      prefix.action.if_index[0] = entry.if_index;
+    }
+    prefixes.push_back(prefix);
+  });
+  if (!shm_fib.publish(prefixes)) {
+    printf("Shared FIB: %u prefixes do not fit, table not updated\n", (uint32_t)prefixes.size());
+    return;
+  }
+  shm_fib_dirty = false;
+}
+
+/**
+ * @brief 收到邻居的 RIP 报文时记录它的 MAC 地址，数据面转发到这个下一跳时不需要 ARP
+ */
+void shm_fib_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac) {
+  if (!shm_fib_enabled) {
+    return;
+  }
+  uint64_t k = ((uint64_t)addr << 32) | if_index;
+  uint64_t value = 0;
+  memcpy(&value, mac, 6);
+  std::unordered_map<uint64_t, uint64_t>::iterator it = shm_fib_macs.find(k);
+  if (it != shm_fib_macs.end() && it->second == value) {
+    return;
+  }
+  if (shm_fib.set_neighbor(addr, if_index, mac)) {
+    shm_fib_macs[k] = value;
+  }
+}
@@ -0,0 +1,227 @@
+#include "rib.h"
+#include "router.h"
+#include "router_hal.h"
+#include "timer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+/*
+  RIB 快照，用于热重启（RIB_SNAPSHOT 为快照文件的路径时）。重启后不必只带着直连路由
+  等邻居在下一轮定时更新中把路由表重新填满，期间的流量也不会因为没有路由被丢弃。
+
+  快照每 SNAPSHOT_INTERVAL 以及进程收到 SIGINT/SIGTERM 退出时保存，内容是所有
+  邻居通告的候选路由和 RIP 邻居的 MAC 地址，直连和静态路由由配置重新得到。
+  文件就是内存中的定长数组：一个头部，后面紧跟路由和邻居，先写到临时文件再 rename ，
+  不会留下写了一半的快照。启动时 mmap 整个文件，检查头部和长度后逐项使用，不需要解析。
+  字节序和布局与本机相同，换了机器或版本的快照因 magic 、版本不符而被忽略。
+
+  恢复的路由是过时（stale）的：按 SNAPSHOT_STALE 之前收到通告处理，邻居在这段时间内
+  重新通告就照常刷新，否则超时删除，与普通的路由超时走同一条路径。
+  恢复的邻居在 ARP 还没有结果时用于转发（以及发布给共享内存中的数据面），
+  所以进程启动后几毫秒内就可以按重启前的路由表转发。
+  只记录 RIB 中还有它通告的候选路由的邻居，路由被撤销或超时后由 snapshot_neighbor_prune 删除。
+*/
+
+#ifndef RIB_SNAPSHOT
+#define RIB_SNAPSHOT "" // 空表示不保存快照
+#endif
+
+#define SNAPSHOT_MAGIC 0x50414E53 // "SNAP"
+#define SNAPSHOT_VERSION 1
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t routes; // 路由的个数
+  uint32_t neighbors; // 邻居的个数
+};
+
+struct SnapshotRoute {
+  uint32_t addr;
+  uint32_t len;
+  uint32_t nexthop;
+  uint32_t if_index;
+  uint32_t metric;
+};
+
+struct SnapshotNeighbor {
+  uint32_t addr;
+  uint32_t if_index;
+  uint8_t mac[6];
+  uint8_t pad[2];
+};
+
+const char *snapshot_path = RIB_SNAPSHOT;
+std::unordered_map<uint64_t, SnapshotNeighbor> snapshot_neighbors; // (addr, if_index) -> 邻居
+
+extern bool rib_update(uint32_t addr, uint32_t len, RibCandidate cand, vector<FibDelta> *deltas);
+extern void rib_learned(vector<RibRoute> *res);
+extern uint32_t rib_neighbor_routes(uint32_t nexthop, uint32_t if_index);
+extern void shm_fib_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac);
+
+/**
+ * @brief 记录一个 RIP 邻居的 MAC 地址，保存在快照中，在处理完它的通告之后调用
+ *
+ * RIB 中没有它通告的候选路由时不记录。
+ */
+void snapshot_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac) {
+  if (snapshot_path[0] == 0 || rib_neighbor_routes(addr, if_index) == 0) {
+    return;
+  }
+  SnapshotNeighbor &neighbor = snapshot_neighbors[((uint64_t)addr << 32) | if_index];
+  neighbor.addr = addr;
+  neighbor.if_index = if_index;
+  memcpy(neighbor.mac, mac, sizeof(neighbor.mac));
+  memset(neighbor.pad, 0, sizeof(neighbor.pad));
+}
+
+/**
+ * @brief 查询记录的邻居的 MAC 地址，ARP 还没有结果时使用
+ * @return 查到则返回 true
+ */
+bool snapshot_neighbor_mac(uint32_t addr, uint32_t if_index, uint8_t *mac) {
+  if (snapshot_path[0] == 0) {
+    return false;
+  }
+  std::unordered_map<uint64_t, SnapshotNeighbor>::iterator it = snapshot_neighbors.find(((uint64_t)addr << 32) | if_index);
+  if (it == snapshot_neighbors.end()) {
+    return false;
+  }
+  memcpy(mac, it->second.mac, sizeof(it->second.mac));
+  return true;
+}
+
+/**
+ * @brief 删除 RIB 中已经没有候选路由的邻居，路由被撤销或超时后调用
+ */
+void snapshot_neighbor_prune() {
+  std::unordered_map<uint64_t, SnapshotNeighbor>::iterator it = snapshot_neighbors.begin();
+  while (it != snapshot_neighbors.end()) {
+    if (rib_neighbor_routes(it->second.addr, it->second.if_index) == 0) {
+      it = snapshot_neighbors.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+/**
+ * @brief 从快照恢复路由和邻居，在定时器启动之后、建立 FIB 之前调用
+ * @param now 当前时间，毫秒
+ * @param deltas FIB 的变化追加到这里
+ * @return 恢复的路由个数，没有快照或快照无效时返回 0
+ */
+uint32_t snapshot_load(uint64_t now, vector<FibDelta> *deltas) {
+  if (snapshot_path[0] == 0) {
+    return 0;
+  }
+  int fd = open(snapshot_path, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+    close(fd);
+    return 0;
+  }
+  size_t size = st.st_size;
+  void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return 0;
+  }
+  const SnapshotHeader *header = (const SnapshotHeader *)p;
+  uint32_t count = 0;
+  if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+      size != sizeof(SnapshotHeader) + (uint64_t)header->routes * sizeof(SnapshotRoute) +
+              (uint64_t)header->neighbors * sizeof(SnapshotNeighbor)) {
+    printf("Snapshot %s is invalid, ignored\n", snapshot_path);
+  } else {
+    const SnapshotRoute *routes = (const SnapshotRoute *)(header + 1);
+    const SnapshotNeighbor *neighbors = (const SnapshotNeighbor *)(routes + header->routes);
+    // 按 SNAPSHOT_STALE 之前收到通告处理，updated 为 0 表示不会超时，不能用
+    uint64_t updated = now + SNAPSHOT_STALE > ROUTE_TIMEOUT ? now + SNAPSHOT_STALE - ROUTE_TIMEOUT : 1;
+    for (uint32_t i = 0; i < header->routes; i++) {
+      const SnapshotRoute &route = routes[i];
+      if (route.len > 32 || (route.addr & ~len_to_mask(route.len)) != 0 ||
+          route.if_index >= N_IFACE_ON_BOARD || route.metric == 0 || route.metric >= 16) {
+        continue;
+      }
+      RibCandidate cand = {
+        .nexthop = route.nexthop,
+        .if_index = route.if_index,
+        .metric = route.metric,
+        .updated = updated,
+        .timer = 0,
+        .chunk = 0
+      };
+      rib_update(route.addr, route.len, cand, deltas);
+      count++;
+    }
+    // 路由已经恢复，没有路由的邻居不用
+    for (uint32_t i = 0; i < header->neighbors; i++) {
+      if (neighbors[i].if_index < N_IFACE_ON_BOARD && rib_neighbor_routes(neighbors[i].addr, neighbors[i].if_index) > 0) {
+        snapshot_neighbor(neighbors[i].addr, neighbors[i].if_index, neighbors[i].mac);
+        shm_fib_neighbor(neighbors[i].addr, neighbors[i].if_index, neighbors[i].mac);
+      }
+    }
+    printf("Snapshot %s: restored %u routes and %u neighbors\n", snapshot_path, count, (uint32_t)snapshot_neighbors.size());
+  }
+  munmap(p, size);
+  return count;
+}
+
+/**
+ * @brief 保存快照
+ * @return 保存成功返回 true ，RIB_SNAPSHOT 为空时什么也不做，返回 false
+ */
+bool snapshot_save() {
+  if (snapshot_path[0] == 0) {
+    return false;
+  }
+  snapshot_neighbor_prune();
+  vector<RibRoute> learned;
+  rib_learned(&learned);
+  SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, (uint32_t)learned.size(), (uint32_t)snapshot_neighbors.size()};
+  vector<uint8_t> buffer(sizeof(header) + learned.size() * sizeof(SnapshotRoute) +
+                         snapshot_neighbors.size() * sizeof(SnapshotNeighbor));
+  memcpy(&buffer[0], &header, sizeof(header));
+  SnapshotRoute *routes = (SnapshotRoute *)&buffer[sizeof(header)];
+  for (uint32_t i = 0; i < learned.size(); i++) {
+    SnapshotRoute route = {learned[i].addr, learned[i].len, learned[i].cand.nexthop, learned[i].cand.if_index, learned[i].cand.metric};
+    routes[i] = route;
+  }
+  SnapshotNeighbor *neighbors = (SnapshotNeighbor *)(routes + learned.size());
+  for (std::unordered_map<uint64_t, SnapshotNeighbor>::iterator it = snapshot_neighbors.begin(); it != snapshot_neighbors.end(); it++) {
+    *neighbors++ = it->second;
+  }
+
+  std::string tmp = std::string(snapshot_path) + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("Failed to save snapshot %s: %s\n", tmp.c_str(), strerror(errno));
+    return false;
+  }
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t n = write(fd, &buffer[written], buffer.size() - written);
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+  close(fd);
+  if (written != buffer.size() || rename(tmp.c_str(), snapshot_path) != 0) {
+    printf("Failed to save snapshot %s: %s\n", snapshot_path, strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
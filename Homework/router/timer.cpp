@@ -0,0 +1,58 @@
+#include "router.h"
+#include "timer.h"
+#include "timer_wheel.h"
+#include <stdint.h>
+
+/*
+  路由器所有的定时器共用一个分层时间轮：定时更新、触发更新、每条候选路由的超时、
+  失效路由的垃圾回收和抑制期。主循环每次调用 timer_advance 逐个处理到期的定时器，
+  几万条路由的超时也不需要周期性地扫描整张路由表。
+*/
+
+TimerWheel<RouterTimer> timers;
+
+/**
+ * @brief 设置时间轮的起始时间，在添加定时器之前调用
+ */
+void timer_start(uint64_t now) {
+  timers.reset(now);
+}
+
+/**
+ * @brief 时间轮当前的时间，即最近一次 timer_advance 推进到的时刻
+ */
+uint64_t timer_now() {
+  return timers.time();
+}
+
+/**
+ * @brief 添加一个定时器
+ * @return 定时器编号，到期或取消之后不再有效
+ */
+uint32_t timer_add(uint64_t expire, RouterTimer timer) {
+  return timers.add(expire, timer);
+}
+
+void timer_modify(uint32_t id, uint64_t expire) {
+  timers.modify(id, expire);
+}
+
+void timer_cancel(uint32_t id) {
+  timers.cancel(id);
+}
+
+/**
+ * @brief 推进到 now ，对每个到期的定时器调用 handler
+ *
+ * handler 中可以添加、取消定时器；处理时 timer_now() 就是它到期的时刻。
+ */
+void timer_advance(uint64_t now, void (*handler)(const RouterTimer &timer)) {
+  timers.advance(now, handler);
+}
+
+/**
+ * @brief 下一次需要调用 timer_advance 的时刻，不晚于 limit
+ */
+uint64_t timer_next(uint64_t limit) {
+  return timers.next_expire(limit);
+}
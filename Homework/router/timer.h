@@ -0,0 +1,55 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// RIP 的各个时间，毫秒，ref. RFC2453 3.8
+#define UPDATE_INTERVAL (5 * 1000) // 定时更新，RFC 中为 30 s，实验中缩短
+#define UPDATE_JITTER (UPDATE_INTERVAL / 6) // 定时更新的间隔随机加减不超过这么多，对应 RFC 中的 30 s +/- 5 s
+#define UPDATE_PACE 1 // 一次定时更新分批发送，批与批之间间隔这么多毫秒，期间照常转发
+#define UPDATE_BURST 4 // 每批最多发送的 RIP 包个数
+#define ROUTE_TIMEOUT (180 * 1000) // 超过这个时间没有收到通告则路由失效
+#define ROUTE_GC (120 * 1000) // 失效的路由以 metric 16 继续通告这么久再删除
+#define ROUTE_HOLDDOWN (120 * 1000) // 路由失效后，这段时间内不接受更差的通告
+#define FIB_BATCH_WINDOW 10 // 收到的通告最多暂存这么久再一起写入路由表
+#define FIB_BATCH_MAX 4096 // 暂存的增量达到这么多时立即写入
+#define SNAPSHOT_INTERVAL (30 * 1000) // 定期保存 RIB 快照的间隔，见 snapshot.cpp
+#define SNAPSHOT_STALE (3 * UPDATE_INTERVAL) // 从快照恢复的路由这么久没有收到通告则失效
+#define XDP_NEIGHBOR_CHECK UPDATE_INTERVAL // XDP 邻居表与 ARP 缓存核对的间隔，见 xdp.cpp
+
+// BFD 邻居存活检测，见 bfd.cpp ，编译时可以修改
+#ifndef BFD_INTERVAL
+#define BFD_INTERVAL 100 // Up 时发送 BFD 包的间隔，毫秒
+#endif
+#ifndef BFD_MULTIPLIER
+#define BFD_MULTIPLIER 3 // 连续这么多个间隔收不到则认为邻居失效
+#endif
+#ifndef BFD_PORTS
+#define BFD_PORTS 0 // 主动发起 BFD 的端口，按位表示；其余端口只应答发来 BFD 包的邻居
+#endif
+
+// 路由器中定时器的种类
+enum TimerKind {
+    TIMER_UPDATE, // 一个端口开始一轮定时更新，if_index 有效
+    TIMER_UPDATE_PACE, // 一个端口发送定时更新的下一批，if_index 有效
+    TIMER_TRIGGERED_UPDATE, // 触发更新
+    TIMER_ROUTE_TIMEOUT, // 一条候选路由超时，addr/len/nexthop/if_index 有效
+    TIMER_ROUTE_GC, // 失效路由的垃圾回收，addr/len 有效
+    TIMER_HOLDDOWN, // 抑制期结束，addr/len 有效
+    TIMER_FIB_COMMIT, // 把暂存的增量写入路由表
+    TIMER_BFD_TX, // 向一个邻居发送 BFD 包，addr/if_index 有效
+    TIMER_BFD_DETECT, // 一个邻居的 BFD 检测时间到期，addr/if_index 有效
+    TIMER_SNAPSHOT, // 定期保存 RIB 快照
+    TIMER_XDP_NEIGHBOR // 定期核对 XDP 邻居表
+};
+
+// 时间轮中的一个定时器
+typedef struct {
+    uint32_t kind;
+    uint32_t addr;
+    uint32_t len;
+    uint32_t nexthop;
+    uint32_t if_index;
+} RouterTimer;
+
+#endif
@@ -0,0 +1,451 @@
+#include "router.h"
+#include "router_hal.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+
+/*
+  XDP 转发快速路径（XDP_FAST_PATH 为 1 时是 generic 模式，可以用在 veth 上，2 时是网卡
+  驱动的 native 模式）。每个端口挂一个 XDP 程序：以太网帧是不带选项的 IPv4 、TTL 大于 1 、
+  校验和正确时，在 LPM_TRIE 路由表中查目的地址，再按 (下一跳, 端口) 在邻居表中查出
+  出端口的网卡和 MAC 地址，减 TTL 、增量更新校验和（RFC 1624）、改写 MAC 后
+  bpf_redirect 到出端口。任何一步不满足都返回 XDP_PASS ，报文照常经 HAL 由用户态处理，
+  所以发给路由器自己的包、RIP 、邻居还没有解析的包都不受影响。
+
+  路由表与压缩后的 fib 完全相同（在 fib_flush 中同步），前缀少；等价多路径的表项
+  标记为交给用户态，保持按流分配，也不会被较短的前缀错误地命中。邻居表由用户态转发时
+  ARP 查询成功的结果填入，同一个流的后续报文就走快速路径。端口失效或 BFD 判定邻居失效时
+  删除相应的邻居，每 XDP_NEIGHBOR_CHECK 再与 ARP 缓存核对一次，MAC 变化的更新，
+  不在 ARP 缓存中的删除，之后的报文回到用户态重新 ARP 。备份路径的切换只在用户态，
+  主路径失效到 RIB 删除路由之间快速路径仍然使用主路径。
+
+  为了不依赖 clang 和 libbpf ，程序用 BPF 指令直接写出，通过 bpf 系统调用加载，
+  用 BPF_LINK_CREATE 挂载，进程退出时自动卸载。
+*/
+
+#ifndef XDP_FAST_PATH
+#define XDP_FAST_PATH 0 // 0 表示不使用
+#endif
+
+#define XDP_MAX_ROUTES 1048576
+#define XDP_MAX_NEIGHBORS 65536
+
+struct XdpRouteKey {
+  uint32_t prefixlen;
+  uint32_t addr;
+};
+
+struct XdpRoute {
+  uint32_t nexthop; // 0 表示直连，按目的地址查邻居
+  uint32_t if_index;
+  uint32_t pass; // 非零表示交给用户态
+};
+
+struct XdpNeighborKey {
+  uint32_t addr;
+  uint32_t if_index;
+};
+
+struct XdpNeighbor {
+  uint32_t ifindex; // 出端口的网卡编号
+  uint8_t dst_mac[6];
+  uint8_t src_mac[6];
+};
+
+uint32_t xdp_mode = XDP_FAST_PATH;
+int xdp_routes_fd = -1, xdp_neighbors_fd = -1, xdp_prog_fd = -1;
+uint32_t xdp_ifindex[N_IFACE_ON_BOARD]; // 端口的网卡编号，0 表示没有找到
+uint8_t xdp_mac[N_IFACE_ON_BOARD][6]; // 端口的网卡的 MAC 地址
+int xdp_links[N_IFACE_ON_BOARD]; // 挂载的链接，关闭即卸载
+std::unordered_map<uint64_t, XdpNeighbor> xdp_neighbors; // 邻居表的副本，避免重复写入
+
+static long sys_bpf(int cmd, union bpf_attr *attr) {
+  return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/*
+  一个极简的 BPF 汇编器：指令依次追加，跳转目标是标签，最后统一回填偏移。
+*/
+struct BpfProgram {
+  vector<struct bpf_insn> insns;
+  vector<int> labels; // 标签 -> 指令下标
+  vector<std::pair<uint32_t, int> > jumps; // (跳转指令下标, 标签)
+
+  void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+    struct bpf_insn insn;
+    memset(&insn, 0, sizeof(insn));
+    insn.code = code;
+    insn.dst_reg = dst;
+    insn.src_reg = src;
+    insn.off = off;
+    insn.imm = imm;
+    insns.push_back(insn);
+  }
+  int label() {
+    labels.push_back(-1);
+    return labels.size() - 1;
+  }
+  void bind(int label) {
+    labels[label] = insns.size();
+  }
+  void alu_imm(uint8_t op, uint8_t dst, int32_t imm) {
+    emit(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm);
+  }
+  void alu_reg(uint8_t op, uint8_t dst, uint8_t src) {
+    emit(BPF_ALU64 | op | BPF_X, dst, src, 0, 0);
+  }
+  void load(uint8_t size, uint8_t dst, uint8_t src, int16_t off) {
+    emit(BPF_LDX | BPF_MEM | size, dst, src, off, 0);
+  }
+  void store(uint8_t size, uint8_t dst, int16_t off, uint8_t src) {
+    emit(BPF_STX | BPF_MEM | size, dst, src, off, 0);
+  }
+  void store_imm(uint8_t size, uint8_t dst, int16_t off, int32_t imm) {
+    emit(BPF_ST | BPF_MEM | size, dst, 0, off, imm);
+  }
+  void jump_imm(uint8_t op, uint8_t dst, int32_t imm, int label) {
+    jumps.push_back(std::make_pair((uint32_t)insns.size(), label));
+    emit(BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+  }
+  void jump_reg(uint8_t op, uint8_t dst, uint8_t src, int label) {
+    jumps.push_back(std::make_pair((uint32_t)insns.size(), label));
+    emit(BPF_JMP | op | BPF_X, dst, src, 0, 0);
+  }
+  void load_map(uint8_t dst, int fd) {
+    emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd);
+    emit(0, 0, 0, 0, 0);
+  }
+  void call(int32_t helper) {
+    emit(BPF_JMP | BPF_CALL, 0, 0, 0, helper);
+  }
+  void exit() {
+    emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+  }
+  void link() {
+    for (uint32_t i = 0; i < jumps.size(); i++) {
+      insns[jumps[i].first].off = labels[jumps[i].second] - jumps[i].first - 1;
+    }
+  }
+};
+
+// 寄存器：r1-r5 是参数和临时变量，r6-r9 在调用之间保持，r10 是栈帧
+enum { R0, R1, R2, R3, R4, R5, R6, R7, R8, R9, R10 };
+
+static void assemble_program(BpfProgram *p) {
+  int pass = p->label();
+  // r7 = data, r3 = data_end
+  p->load(BPF_W, R7, R1, 0);
+  p->load(BPF_W, R3, R1, 4);
+  // 以太网头 14 字节，IPv4 头 20 字节
+  p->alu_reg(BPF_MOV, R4, R7);
+  p->alu_imm(BPF_ADD, R4, 34);
+  p->jump_reg(BPF_JGT, R4, R3, pass);
+  // 按主机序读取报文中的 16 位值，常数也按主机序写
+  p->load(BPF_H, R4, R7, 12);
+  p->jump_imm(BPF_JNE, R4, htons(0x0800), pass);
+  p->load(BPF_B, R4, R7, 14);
+  p->jump_imm(BPF_JNE, R4, 0x45, pass);
+  p->load(BPF_B, R4, R7, 22);
+  p->jump_imm(BPF_JLE, R4, 1, pass);
+  // 校验和：10 个 16 位字的反码和应为 0xFFFF ，与字节序无关
+  p->alu_imm(BPF_MOV, R5, 0);
+  for (int i = 0; i < 10; i++) {
+    p->load(BPF_H, R4, R7, 14 + 2 * i);
+    p->alu_reg(BPF_ADD, R5, R4);
+  }
+  for (int i = 0; i < 2; i++) {
+    p->alu_reg(BPF_MOV, R4, R5);
+    p->alu_imm(BPF_RSH, R4, 16);
+    p->alu_imm(BPF_AND, R5, 0xFFFF);
+    p->alu_reg(BPF_ADD, R5, R4);
+  }
+  p->jump_imm(BPF_JNE, R5, 0xFFFF, pass);
+
+  // 路由表：键是 (32, 目的地址)
+  p->store_imm(BPF_W, R10, -8, 32);
+  p->load(BPF_W, R4, R7, 30);
+  p->store(BPF_W, R10, -4, R4);
+  p->load_map(R1, xdp_routes_fd);
+  p->alu_reg(BPF_MOV, R2, R10);
+  p->alu_imm(BPF_ADD, R2, -8);
+  p->call(BPF_FUNC_map_lookup_elem);
+  p->jump_imm(BPF_JEQ, R0, 0, pass);
+  p->load(BPF_W, R4, R0, 8);
+  p->jump_imm(BPF_JNE, R4, 0, pass);
+  // 邻居表：键是 (下一跳，直连时为目的地址, 端口)
+  int has_nexthop = p->label();
+  p->load(BPF_W, R4, R0, 0);
+  p->jump_imm(BPF_JNE, R4, 0, has_nexthop);
+  p->load(BPF_W, R4, R7, 30);
+  p->bind(has_nexthop);
+  p->store(BPF_W, R10, -16, R4);
+  p->load(BPF_W, R4, R0, 4);
+  p->store(BPF_W, R10, -12, R4);
+  p->load_map(R1, xdp_neighbors_fd);
+  p->alu_reg(BPF_MOV, R2, R10);
+  p->alu_imm(BPF_ADD, R2, -16);
+  p->call(BPF_FUNC_map_lookup_elem);
+  p->jump_imm(BPF_JEQ, R0, 0, pass);
+  p->alu_reg(BPF_MOV, R8, R0);
+
+  // TTL 减一，校验和按 RFC 1624 增量更新：TTL 所在的 16 位字减少 0x0100
+  p->load(BPF_B, R4, R7, 22);
+  p->alu_imm(BPF_ADD, R4, -1);
+  p->store(BPF_B, R7, 22, R4);
+  int no_carry = p->label();
+  p->load(BPF_H, R4, R7, 24);
+  p->alu_imm(BPF_ADD, R4, htons(0x0100));
+  p->jump_imm(BPF_JLT, R4, 0xFFFF, no_carry);
+  p->alu_imm(BPF_ADD, R4, 1);
+  p->bind(no_carry);
+  p->store(BPF_H, R7, 24, R4);
+  // 目的 MAC 和源 MAC
+  p->load(BPF_W, R4, R8, 4);
+  p->store(BPF_W, R7, 0, R4);
+  p->load(BPF_H, R4, R8, 8);
+  p->store(BPF_H, R7, 4, R4);
+  p->load(BPF_H, R4, R8, 10);
+  p->store(BPF_H, R7, 6, R4);
+  p->load(BPF_W, R4, R8, 12);
+  p->store(BPF_W, R7, 8, R4);
+  // return bpf_redirect(ifindex, 0)
+  p->load(BPF_W, R1, R8, 0);
+  p->alu_imm(BPF_MOV, R2, 0);
+  p->call(BPF_FUNC_redirect);
+  p->exit();
+
+  p->bind(pass);
+  p->alu_imm(BPF_MOV, R0, XDP_PASS);
+  p->exit();
+  p->link();
+}
+
+static int create_map(uint32_t type, uint32_t key_size, uint32_t value_size, uint32_t max_entries, uint32_t flags) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_type = type;
+  attr.key_size = key_size;
+  attr.value_size = value_size;
+  attr.max_entries = max_entries;
+  attr.map_flags = flags;
+  return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static bool map_update(int fd, const void *key, const void *value) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = fd;
+  attr.key = (uint64_t)(uintptr_t)key;
+  attr.value = (uint64_t)(uintptr_t)value;
+  attr.flags = BPF_ANY;
+  return sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) == 0;
+}
+
+static void map_delete(int fd, const void *key) {
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.map_fd = fd;
+  attr.key = (uint64_t)(uintptr_t)key;
+  sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+static int load_program() {
+  BpfProgram p;
+  assemble_program(&p);
+  static char log[65536];
+  log[0] = 0;
+  union bpf_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uint64_t)(uintptr_t)p.insns.data();
+  attr.insn_cnt = p.insns.size();
+  attr.license = (uint64_t)(uintptr_t)"GPL";
+  attr.log_buf = (uint64_t)(uintptr_t)log;
+  attr.log_size = sizeof(log);
+  attr.log_level = 1;
+  int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+  if (fd < 0) {
+    printf("XDP: program rejected: %s\n%s\n", strerror(errno), log);
+  }
+  return fd;
+}
+
+// 端口对应的网卡：配置了这个端口地址的网卡，同时取出它的 MAC 地址
+static uint32_t find_port(in_addr_t addr, uint8_t *mac) {
+  struct ifaddrs *ifaddr, *ifa;
+  const char *name = NULL;
+  if (getifaddrs(&ifaddr) < 0) {
+    return 0;
+  }
+  for (ifa = ifaddr; ifa != NULL && name == NULL; ifa = ifa->ifa_next) {
+    if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET &&
+        ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr == addr) {
+      name = ifa->ifa_name;
+    }
+  }
+  uint32_t res = 0;
+  for (ifa = ifaddr; ifa != NULL && name != NULL; ifa = ifa->ifa_next) {
+    if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_PACKET &&
+        strcmp(ifa->ifa_name, name) == 0) {
+      memcpy(mac, ((struct sockaddr_ll *)ifa->ifa_addr)->sll_addr, 6);
+      res = if_nametoindex(name);
+      break;
+    }
+  }
+  freeifaddrs(ifaddr);
+  return res;
+}
+
+/**
+ * @brief 建立路由表和邻居表，加载 XDP 程序并挂到每个端口的网卡上，XDP_FAST_PATH 为 0 时什么也不做
+ * @param if_addrs 每个端口的 IPv4 地址，用来找到对应的网卡
+ * @return 挂载成功的端口个数
+ */
+uint32_t xdp_open(const in_addr_t *if_addrs) {
+  if (xdp_mode == 0) {
+    return 0;
+  }
+  xdp_routes_fd = create_map(BPF_MAP_TYPE_LPM_TRIE, sizeof(XdpRouteKey), sizeof(XdpRoute), XDP_MAX_ROUTES, BPF_F_NO_PREALLOC);
+  xdp_neighbors_fd = create_map(BPF_MAP_TYPE_HASH, sizeof(XdpNeighborKey), sizeof(XdpNeighbor), XDP_MAX_NEIGHBORS, 0);
+  if (xdp_routes_fd < 0 || xdp_neighbors_fd < 0) {
+    printf("XDP: failed to create maps: %s\n", strerror(errno));
+    return 0;
+  }
+  xdp_prog_fd = load_program();
+  if (xdp_prog_fd < 0) {
+    return 0;
+  }
+  uint32_t attached = 0;
+  for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+    xdp_ifindex[i] = find_port(if_addrs[i], xdp_mac[i]);
+    if (xdp_ifindex[i] == 0) {
+      continue;
+    }
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = xdp_prog_fd;
+    attr.link_create.target_ifindex = xdp_ifindex[i];
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = xdp_mode == 1 ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+    // 链接的 fd 保持打开，进程退出时卸载
+    xdp_links[i] = sys_bpf(BPF_LINK_CREATE, &attr);
+    if (xdp_links[i] < 0) {
+      printf("XDP: failed to attach to port %u: %s\n", i, strerror(errno));
+      xdp_ifindex[i] = 0;
+    } else {
+      attached++;
+    }
+  }
+  return attached;
+}
+
+/**
+ * @brief 同步压缩后的 fib 的一次变化，参数与 update 相同
+ */
+void xdp_route(bool insert, const RoutingTableEntry &entry) {
+  if (xdp_prog_fd < 0) {
+    return;
+  }
+  XdpRouteKey key = {entry.len, entry.addr};
+  if (!insert) {
+    map_delete(xdp_routes_fd, &key);
+    return;
+  }
+  XdpRoute route = {entry.nexthop, entry.if_index, 0};
+  // 等价多路径按流选择，出端口不在快速路径中的也交给用户态
+  route.pass = entry.group != 0 || entry.if_index >= N_IFACE_ON_BOARD || xdp_ifindex[entry.if_index] == 0;
+  if (!map_update(xdp_routes_fd, &key, &route)) {
+    // 写不进去时更短的前缀会被错误地命中，只能卸载，全部交给用户态
+    printf("XDP: failed to add route %s/%u: %s, fast path disabled\n", ip_string(entry.addr).c_str(), entry.len, strerror(errno));
+    for (uint32_t i = 0; i < N_IFACE_ON_BOARD; i++) {
+      if (xdp_ifindex[i] != 0) {
+        close(xdp_links[i]);
+        xdp_ifindex[i] = 0;
+      }
+    }
+    close(xdp_prog_fd);
+    xdp_prog_fd = -1;
+  }
+}
+
+/**
+ * @brief 用户态转发时 ARP 查询成功，把邻居写入邻居表
+ * @param addr 下一跳地址，直连时是目的地址
+ */
+void xdp_neighbor(uint32_t addr, uint32_t if_index, const uint8_t *mac) {
+  if (xdp_prog_fd < 0 || xdp_ifindex[if_index] == 0) {
+    return;
+  }
+  XdpNeighbor neighbor;
+  memset(&neighbor, 0, sizeof(neighbor));
+  neighbor.ifindex = xdp_ifindex[if_index];
+  memcpy(neighbor.dst_mac, mac, sizeof(neighbor.dst_mac));
+  memcpy(neighbor.src_mac, xdp_mac[if_index], sizeof(neighbor.src_mac));
+  uint64_t k = ((uint64_t)addr << 32) | if_index;
+  std::unordered_map<uint64_t, XdpNeighbor>::iterator it = xdp_neighbors.find(k);
+  if (it != xdp_neighbors.end() && memcmp(&it->second, &neighbor, sizeof(neighbor)) == 0) {
+    return;
+  }
+  XdpNeighborKey key = {addr, if_index};
+  if (map_update(xdp_neighbors_fd, &key, &neighbor)) {
+    xdp_neighbors[k] = neighbor;
+  }
+}
+
+/**
+ * @brief 从邻居表删除一个邻居，BFD 判定它失效时调用
+ */
+void xdp_neighbor_down(uint32_t addr, uint32_t if_index) {
+  if (xdp_neighbors.erase(((uint64_t)addr << 32) | if_index) > 0) {
+    XdpNeighborKey key = {addr, if_index};
+    map_delete(xdp_neighbors_fd, &key);
+  }
+}
+
+/**
+ * @brief 从邻居表删除一个端口上的所有邻居，端口失效时调用
+ */
+void xdp_port_down(uint32_t if_index) {
+  std::unordered_map<uint64_t, XdpNeighbor>::iterator it = xdp_neighbors.begin();
+  while (it != xdp_neighbors.end()) {
+    if ((uint32_t)it->first == if_index) {
+      XdpNeighborKey key = {(uint32_t)(it->first >> 32), if_index};
+      map_delete(xdp_neighbors_fd, &key);
+      it = xdp_neighbors.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+/**
+ * @brief 与 ARP 缓存核对邻居表：MAC 地址变化的更新，ARP 缓存中没有的删除
+ * @param arp 查询 ARP 缓存，即 HAL_ArpGetMacAddress ，由调用者传入，bench 不链接 HAL
+ */
+void xdp_neighbor_check(int (*arp)(int if_index, in_addr_t ip, macaddr_t o_mac)) {
+  vector<XdpNeighborKey> stale;
+  for (std::unordered_map<uint64_t, XdpNeighbor>::iterator it = xdp_neighbors.begin(); it != xdp_neighbors.end(); it++) {
+    XdpNeighborKey key = {(uint32_t)(it->first >> 32), (uint32_t)it->first};
+    macaddr_t mac;
+    if (arp(key.if_index, key.addr, mac) != 0) {
+      stale.push_back(key);
+    } else if (memcmp(mac, it->second.dst_mac, sizeof(mac)) != 0) {
+      memcpy(it->second.dst_mac, mac, sizeof(mac));
+      if (!map_update(xdp_neighbors_fd, &key, &it->second)) {
+        stale.push_back(key);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < stale.size(); i++) {
+    xdp_neighbor_down(stale[i].addr, stale[i].if_index);
+  }
+}